@@ -0,0 +1,236 @@
+-module(greenbar_bench).
+
+%% Load benchmark for greenbar_markdown:analyze.
+%%
+%% Runs analyze concurrently from many processes for each input size and
+%% reports what the calls cost the rest of the VM as well as their speed:
+%% throughput, call latency percentiles, scheduler utilization, long_schedule
+%% events, the lateness of a 1ms heartbeat process and the heap and GC cost of
+%% the returned terms.
+%%
+%%   rebar3 as bench shell
+%%   1> greenbar_bench:run().
+%%   2> greenbar_bench:run([{processes, [1, 8]}, {sizes, [4096]}, {output, "before.term"}]).
+%%
+%% Options:
+%%   {duration, Ms}         measuring time per scenario, default 2000
+%%   {processes, [N]}       concurrent callers, default [1, Schedulers, 4 * Schedulers]
+%%   {sizes, [Bytes]}       input sizes built from the corpus, default [1024, 16384, 262144]
+%%   {corpus, Dir}          Markdown documents to build inputs from, default c_src/bench/corpus
+%%   {options, Opts}        passed to analyze/2 when not empty
+%%   {long_schedule, Ms}    long_schedule monitor threshold, default 5
+%%   {output, File}         also write the results as an Erlang term
+
+-export([run/0,
+         run/1]).
+
+-define(SAMPLES_PER_PROCESS, 5000).
+-define(HEARTBEAT_MS, 1).
+
+run() ->
+  run([]).
+
+run(Options) ->
+  Schedulers = erlang:system_info(schedulers),
+  Duration = proplists:get_value(duration, Options, 2000),
+  Procs = proplists:get_value(processes, Options, [1, Schedulers, 4 * Schedulers]),
+  Sizes = proplists:get_value(sizes, Options, [1024, 16384, 262144]),
+  Corpus = load_corpus(proplists:get_value(corpus, Options, "c_src/bench/corpus")),
+  AnalyzeOpts = proplists:get_value(options, Options, []),
+  LongSchedule = proplists:get_value(long_schedule, Options, 5),
+  Results = [scenario(make_input(Corpus, Size), N, Duration, AnalyzeOpts, LongSchedule) ||
+              Size <- Sizes, N <- Procs],
+  print_results(Results),
+  case proplists:get_value(output, Options) of
+    undefined ->
+      ok;
+    File ->
+      ok = file:write_file(File, io_lib:format("~p.~n", [Results]))
+  end,
+  Results.
+
+load_corpus(Dir) ->
+  case filelib:wildcard(filename:join(Dir, "*.md")) of
+    [] ->
+      erlang:error({empty_corpus, Dir});
+    Files ->
+      [begin {ok, Bin} = file:read_file(File), Bin end || File <- lists:sort(Files)]
+  end.
+
+%% Concatenates corpus documents, separated by blank lines, up to Size bytes
+make_input(Corpus, Size) ->
+  make_input(Corpus, Corpus, Size, []).
+
+make_input(_Corpus, _Rest, Size, Acc) when Size =< 0 ->
+  iolist_to_binary(lists:reverse(Acc));
+make_input(Corpus, [], Size, Acc) ->
+  make_input(Corpus, Corpus, Size, Acc);
+make_input(Corpus, [Doc|Rest], Size, Acc) ->
+  Part = binary:part(Doc, 0, min(byte_size(Doc), Size)),
+  make_input(Corpus, Rest, Size - byte_size(Part) - 2, [<<"\n\n">>, Part|Acc]).
+
+analyze(Input, []) ->
+  greenbar_markdown:analyze(Input);
+analyze(Input, Opts) ->
+  greenbar_markdown:analyze(Input, Opts).
+
+scenario(Input, Procs, Duration, Opts, LongSchedule) ->
+  erlang:garbage_collect(),
+  {ok, Tree} = analyze(Input, Opts),
+  ResultWords = erts_debug:flat_size(Tree),
+  OldMonitor = erlang:system_monitor(self(), [{long_schedule, LongSchedule}]),
+  OldWallTime = erlang:system_flag(scheduler_wall_time, true),
+  Wall0 = lists:sort(erlang:statistics(scheduler_wall_time)),
+  {GCs0, Reclaimed0, _} = erlang:statistics(garbage_collection),
+  Msacc = msacc_start(),
+  Heartbeat = spawn_link(fun() -> heartbeat(0, #{}) end),
+  Start = erlang:monotonic_time(micro_seconds),
+  Deadline = Start + Duration * 1000,
+  Workers = [spawn_monitor(fun() -> exit({done, worker(Input, Opts, Deadline, 0, 0, #{})}) end) ||
+              _ <- lists:seq(1, Procs)],
+  {Calls, Latencies, LongEvents} = collect(length(Workers), 0, [], []),
+  Elapsed = erlang:monotonic_time(micro_seconds) - Start,
+  Heartbeat ! {stop, self()},
+  Lateness = receive {heartbeat, Samples} -> Samples end,
+  MsaccStats = msacc_stop(Msacc),
+  {GCs1, Reclaimed1, _} = erlang:statistics(garbage_collection),
+  Wall1 = lists:sort(erlang:statistics(scheduler_wall_time)),
+  erlang:system_flag(scheduler_wall_time, OldWallTime),
+  restore_monitor(OldMonitor),
+  flush_monitor(),
+  WordSize = erlang:system_info(wordsize),
+  #{input_bytes => byte_size(Input),
+    processes => Procs,
+    calls => Calls,
+    calls_per_s => Calls * 1000000 / Elapsed,
+    mb_per_s => Calls * byte_size(Input) / Elapsed,
+    latency_us => percentiles(Latencies),
+    scheduler_utilization => utilization(Wall0, Wall1),
+    msacc => MsaccStats,
+    long_schedule => #{count => length(LongEvents),
+                       max_ms => lists:max([0|LongEvents])},
+    heartbeat_lateness_us => percentiles(Lateness),
+    result_bytes => ResultWords * WordSize,
+    gc_per_call => (GCs1 - GCs0) / max(Calls, 1),
+    reclaimed_bytes_per_call => (Reclaimed1 - Reclaimed0) * WordSize / max(Calls, 1)}.
+
+%% Calls analyze until the deadline, keeping a uniform sample of latencies
+worker(Input, Opts, Deadline, Calls, Kept, Samples) ->
+  T0 = erlang:monotonic_time(micro_seconds),
+  case T0 >= Deadline of
+    true ->
+      {Calls, maps:values(Samples)};
+    false ->
+      {ok, _} = analyze(Input, Opts),
+      Latency = erlang:monotonic_time(micro_seconds) - T0,
+      {Kept1, Samples1} = sample(Latency, Calls, Kept, Samples),
+      worker(Input, Opts, Deadline, Calls + 1, Kept1, Samples1)
+  end.
+
+%% Reservoir sampling keeps memory flat however many calls are made
+sample(Value, _Seen, Kept, Samples) when Kept < ?SAMPLES_PER_PROCESS ->
+  {Kept + 1, maps:put(Kept + 1, Value, Samples)};
+sample(Value, Seen, Kept, Samples) ->
+  case rand:uniform(Seen + 1) of
+    N when N =< Kept ->
+      {Kept, maps:put(N, Value, Samples)};
+    _ ->
+      {Kept, Samples}
+  end.
+
+collect(0, Calls, Latencies, LongEvents) ->
+  {Calls, lists:append(Latencies), LongEvents};
+collect(Pending, Calls, Latencies, LongEvents) ->
+  receive
+    {'DOWN', _, process, _, {done, {WorkerCalls, Samples}}} ->
+      collect(Pending - 1, Calls + WorkerCalls, [Samples|Latencies], LongEvents);
+    {'DOWN', _, process, _, Reason} ->
+      erlang:error({worker_failed, Reason});
+    {monitor, _, long_schedule, Info} ->
+      Ms = proplists:get_value(timeout, Info, 0),
+      collect(Pending, Calls, Latencies, [Ms|LongEvents])
+  end.
+
+%% Sleeps for 1ms at a time and records how late it wakes up.
+%% Busy schedulers show up here before they show up in throughput.
+heartbeat(Count, Samples) ->
+  T0 = erlang:monotonic_time(micro_seconds),
+  receive
+    {stop, From} ->
+      From ! {heartbeat, maps:values(Samples)}
+  after ?HEARTBEAT_MS ->
+      Late = erlang:monotonic_time(micro_seconds) - T0 - ?HEARTBEAT_MS * 1000,
+      {_, Samples1} = sample(max(Late, 0), Count, min(Count, ?SAMPLES_PER_PROCESS), Samples),
+      heartbeat(Count + 1, Samples1)
+  end.
+
+flush_monitor() ->
+  receive
+    {monitor, _, long_schedule, _} ->
+      flush_monitor()
+  after 0 ->
+      ok
+  end.
+
+restore_monitor(undefined) ->
+  erlang:system_monitor(undefined);
+restore_monitor({Pid, Options}) ->
+  erlang:system_monitor(Pid, Options).
+
+percentiles([]) ->
+  #{};
+percentiles(Values) ->
+  Sorted = list_to_tuple(lists:sort(Values)),
+  N = tuple_size(Sorted),
+  Nth = fun(P) -> element(max(1, min(N, round(N * P))), Sorted) end,
+  #{p50 => Nth(0.50), p90 => Nth(0.90), p99 => Nth(0.99), max => element(N, Sorted)}.
+
+utilization(Wall0, Wall1) ->
+  {Active, Total} = lists:foldl(fun({{I, A0, T0}, {I, A1, T1}}, {A, T}) ->
+                                    {A + (A1 - A0), T + (T1 - T0)}
+                                end, {0, 0}, lists:zip(Wall0, Wall1)),
+  case Total of
+    0 -> 0.0;
+    _ -> Active / Total
+  end.
+
+%% Microstate accounting is only available from OTP 19
+msacc_start() ->
+  case code:ensure_loaded(msacc) of
+    {module, msacc} ->
+      msacc:start(),
+      true;
+    _ ->
+      false
+  end.
+
+msacc_stop(false) ->
+  unavailable;
+msacc_stop(true) ->
+  msacc:stop(),
+  Stats = msacc:stats(),
+  msacc:reset(),
+  Counters = [Counters || #{type := scheduler, counters := Counters} <- Stats],
+  Totals = lists:foldl(fun(Thread, Acc) ->
+                           maps:fold(fun(State, Time, Acc1) ->
+                                         maps:update_with(State, fun(T) -> T + Time end, Time, Acc1)
+                                     end, Acc, Thread)
+                       end, #{}, Counters),
+  Sum = lists:sum(maps:values(Totals)),
+  maps:map(fun(_State, Time) -> Time / max(Sum, 1) end, Totals).
+
+print_results(Results) ->
+  io:format("~8s ~6s ~10s ~9s ~9s ~9s ~9s ~6s ~9s ~9s ~9s ~10s~n",
+            ["bytes", "procs", "calls/s", "MB/s", "p50 us", "p99 us", "max us", "util",
+             "long_sch", "hb p99", "hb max", "result KB"]),
+  [print_row(Result) || Result <- Results],
+  ok.
+
+print_row(#{input_bytes := Bytes, processes := Procs, calls_per_s := CallsPerS, mb_per_s := MBPerS,
+            latency_us := Latency, scheduler_utilization := Util, long_schedule := #{count := Long},
+            heartbeat_lateness_us := Heartbeat, result_bytes := ResultBytes}) ->
+  io:format("~8B ~6B ~10.1f ~9.2f ~9B ~9B ~9B ~5.1f% ~9B ~9B ~9B ~10.1f~n",
+            [Bytes, Procs, float(CallsPerS), float(MBPerS),
+             maps:get(p50, Latency, 0), maps:get(p99, Latency, 0), maps:get(max, Latency, 0),
+             Util * 100, Long, maps:get(p99, Heartbeat, 0), maps:get(max, Heartbeat, 0),
+             ResultBytes / 1024]).
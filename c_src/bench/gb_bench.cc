@@ -0,0 +1,452 @@
+// Native benchmark for the analyzer library.
+//
+// Usage: gb_bench [-t millis] [-r revision] [-o file] [-c baseline] path...
+//   -t  minimum measuring time per document and phase, default 500
+//   -r  revision recorded in the results
+//   -o  write JSON results to file instead of stdout
+//   -c  compare analyze times with earlier results, printed to stderr
+// Paths are Markdown files or directories of *.md files. Documents are mmap'd.
+//
+// Phases per document:
+//   hoedown   hoedown render with no callbacks, the baseline parse cost
+//   analyze   full render into the node tree, callbacks included
+//   teardown  releasing the tree back to the pool
+// Term conversion needs a running VM and is covered by the Erlang benchmarks.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gb_memory.hpp"
+#include "markdown_analyzer.hpp"
+#include "markdown_parser.hpp"
+
+using namespace greenbar;
+
+// Allocation counters. C++ allocations are counted through operator new.
+// hoedown's malloc calls are counted when linked with --wrap (Linux only).
+struct AllocCount {
+  size_t allocs;
+  size_t frees;
+  size_t bytes;
+};
+
+static AllocCount alloc_count = {0, 0, 0};
+
+#ifdef GB_BENCH_WRAP_MALLOC
+extern "C" {
+  void* __real_malloc(size_t size);
+  void* __real_calloc(size_t count, size_t size);
+  void* __real_realloc(void* ptr, size_t size);
+  void __real_free(void* ptr);
+
+  void* __wrap_malloc(size_t size) {
+    alloc_count.allocs++;
+    alloc_count.bytes += size;
+    return __real_malloc(size);
+  }
+
+  void* __wrap_calloc(size_t count, size_t size) {
+    alloc_count.allocs++;
+    alloc_count.bytes += count * size;
+    return __real_calloc(count, size);
+  }
+
+  void* __wrap_realloc(void* ptr, size_t size) {
+    alloc_count.allocs++;
+    alloc_count.bytes += size;
+    return __real_realloc(ptr, size);
+  }
+
+  void __wrap_free(void* ptr) {
+    if (ptr != nullptr) {
+      alloc_count.frees++;
+    }
+    __real_free(ptr);
+  }
+}
+#define RAW_MALLOC __real_malloc
+#define RAW_FREE __real_free
+#else
+#define RAW_MALLOC malloc
+#define RAW_FREE free
+#endif
+
+void* operator new(size_t size) {
+  alloc_count.allocs++;
+  alloc_count.bytes += size;
+  void* ptr = RAW_MALLOC(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr != nullptr) {
+    alloc_count.frees++;
+  }
+  RAW_FREE(ptr);
+}
+
+struct Document {
+  std::string name;
+  const uint8_t* data;
+  size_t size;
+};
+
+struct PhaseStats {
+  size_t iterations;
+  double mean_us;
+  double p50_us;
+  double p90_us;
+  double p99_us;
+  double max_us;
+};
+
+struct DocumentResult {
+  PhaseStats hoedown;
+  PhaseStats analyze;
+  PhaseStats teardown;
+  AllocCount analyze_allocs;
+  AllocCount teardown_allocs;
+  size_t nodes;
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_us(bench_clock::time_point start, bench_clock::time_point end) {
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+static PhaseStats summarize(std::vector<double>& samples) {
+  PhaseStats stats;
+  std::sort(samples.begin(), samples.end());
+  double total = 0;
+  for (auto sample : samples) {
+    total += sample;
+  }
+  size_t n = samples.size();
+  stats.iterations = n;
+  stats.mean_us = total / n;
+  stats.p50_us = samples[n / 2];
+  stats.p90_us = samples[(n * 90) / 100];
+  stats.p99_us = samples[(n * 99) / 100];
+  stats.max_us = samples[n - 1];
+  return stats;
+}
+
+static bool map_file(const std::string& path, std::vector<Document>& docs) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: cannot open\n", path.c_str());
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return false;
+  }
+  Document doc;
+  doc.name = path.substr(path.find_last_of('/') + 1);
+  doc.size = info.st_size;
+  doc.data = (const uint8_t*) "";
+  if (doc.size > 0) {
+    void* data = mmap(nullptr, doc.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "%s: mmap failed\n", path.c_str());
+      close(fd);
+      return false;
+    }
+    doc.data = (const uint8_t*) data;
+  }
+  close(fd);
+  docs.push_back(doc);
+  return true;
+}
+
+static bool load_path(const std::string& path, std::vector<Document>& docs) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    fprintf(stderr, "%s: not found\n", path.c_str());
+    return false;
+  }
+  if (!S_ISDIR(info.st_mode)) {
+    return map_file(path, docs);
+  }
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  std::vector<std::string> names;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    std::string name(entry->d_name);
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, ".md") == 0) {
+      names.push_back(name);
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  for (auto& name : names) {
+    if (!map_file(path + "/" + name, docs)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Baseline: hoedown parsing with every callback left empty
+static PhaseStats bench_hoedown(const Document& doc, double min_us) {
+  hoedown_renderer renderer;
+  memset(&renderer, 0, sizeof(renderer));
+  auto document = new_hoedown_document(&renderer);
+  auto ob = hoedown_buffer_new(128);
+  std::vector<double> samples;
+  double total = 0;
+  while (total < min_us || samples.size() < 5) {
+    auto start = bench_clock::now();
+    hoedown_document_render(document, ob, doc.data, doc.size);
+    auto sample = elapsed_us(start, bench_clock::now());
+    ob->size = 0;
+    samples.push_back(sample);
+    total += sample;
+  }
+  hoedown_buffer_free(ob);
+  hoedown_document_free(document);
+  return summarize(samples);
+}
+
+static void bench_analyzer(MarkdownParser& parser, const Document& doc, double min_us, DocumentResult& result) {
+  const ParseLimits& limits = parser.config().limits;
+  // Small documents take the NIF's arena lane, which starts empty for
+  // every parse
+  bool small = doc.size <= GB_SMALL_INPUT;
+  // One counted pass first so allocation numbers cover a single parse
+  if (small) {
+    memory::begin_arena();
+  }
+  auto pooled = parser.acquire();
+  AllocCount before = alloc_count;
+  parser.render(pooled, doc.data, doc.size, limits);
+  AllocCount rendered = alloc_count;
+  result.nodes = get_limits(pooled->analyzer)->node_count();
+  parser.release(pooled);
+  AllocCount released = alloc_count;
+  if (small) {
+    memory::end_arena();
+  }
+  result.analyze_allocs = {rendered.allocs - before.allocs, rendered.frees - before.frees, rendered.bytes - before.bytes};
+  result.teardown_allocs = {released.allocs - rendered.allocs, released.frees - rendered.frees,
+                            released.bytes - rendered.bytes};
+
+  std::vector<double> analyze_samples;
+  std::vector<double> teardown_samples;
+  double total = 0;
+  while (total < min_us || analyze_samples.size() < 5) {
+    if (small) {
+      memory::begin_arena();
+    }
+    pooled = parser.acquire();
+    auto start = bench_clock::now();
+    parser.render(pooled, doc.data, doc.size, limits);
+    auto mid = bench_clock::now();
+    parser.release(pooled);
+    auto end = bench_clock::now();
+    if (small) {
+      memory::end_arena();
+    }
+    analyze_samples.push_back(elapsed_us(start, mid));
+    teardown_samples.push_back(elapsed_us(mid, end));
+    total += elapsed_us(start, mid);
+  }
+  result.analyze = summarize(analyze_samples);
+  result.teardown = summarize(teardown_samples);
+}
+
+static void print_phase(FILE* out, const char* name, const PhaseStats& stats, size_t bytes, bool last) {
+  double mb_per_s = stats.mean_us > 0 ? bytes / stats.mean_us : 0;
+  double docs_per_s = stats.mean_us > 0 ? 1e6 / stats.mean_us : 0;
+  fprintf(out, "        \"%s\": {\"iterations\": %zu, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p90_us\": %.3f, "
+          "\"p99_us\": %.3f, \"max_us\": %.3f, \"mb_per_s\": %.3f, \"docs_per_s\": %.1f}%s\n",
+          name, stats.iterations, stats.mean_us, stats.p50_us, stats.p90_us, stats.p99_us, stats.max_us,
+          mb_per_s, docs_per_s, last ? "" : ",");
+}
+
+static void print_allocs(FILE* out, const char* name, const AllocCount& count, bool last) {
+  fprintf(out, "        \"%s\": {\"allocs\": %zu, \"frees\": %zu, \"bytes\": %zu}%s\n",
+          name, count.allocs, count.frees, count.bytes, last ? "" : ",");
+}
+
+static void print_json_string(FILE* out, const std::string& value) {
+  fputc('"', out);
+  for (auto c : value) {
+    if (c == '"' || c == '\\') {
+      fputc('\\', out);
+    }
+    fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+static void print_results(FILE* out, const std::string& revision, double min_ms,
+                          const std::vector<Document>& docs, const std::vector<DocumentResult>& results) {
+  size_t total_bytes = 0;
+  double total_us = 0;
+  fprintf(out, "{\n  \"revision\": ");
+  print_json_string(out, revision);
+  fprintf(out, ",\n  \"min_time_ms\": %.0f,\n  \"documents\": [\n", min_ms);
+  for (size_t i = 0; i < docs.size(); i++) {
+    auto& doc = docs[i];
+    auto& result = results[i];
+    total_bytes += doc.size;
+    total_us += result.analyze.mean_us;
+    fprintf(out, "    {\n      \"name\": ");
+    print_json_string(out, doc.name);
+    fprintf(out, ",\n      \"bytes\": %zu,\n      \"nodes\": %zu,\n", doc.size, result.nodes);
+    fprintf(out, "      \"callbacks_p50_us\": %.3f,\n", std::max(0.0, result.analyze.p50_us - result.hoedown.p50_us));
+    fprintf(out, "      \"phases\": {\n");
+    print_phase(out, "hoedown", result.hoedown, doc.size, false);
+    print_phase(out, "analyze", result.analyze, doc.size, false);
+    print_phase(out, "teardown", result.teardown, doc.size, true);
+    fprintf(out, "      },\n      \"allocations\": {\n");
+    print_allocs(out, "analyze", result.analyze_allocs, false);
+    print_allocs(out, "teardown", result.teardown_allocs, true);
+    fprintf(out, "      }\n    }%s\n", i + 1 < docs.size() ? "," : "");
+  }
+  fprintf(out, "  ],\n  \"total\": {\"documents\": %zu, \"bytes\": %zu, \"analyze_mb_per_s\": %.3f, "
+          "\"analyze_docs_per_s\": %.1f}\n}\n",
+          docs.size(), total_bytes, total_us > 0 ? total_bytes / total_us : 0,
+          total_us > 0 ? docs.size() * 1e6 / total_us : 0);
+}
+
+// Reads document names and analyze mean times back from results written above
+static bool load_baseline(const char* path, std::map<std::string, double>& means) {
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return false;
+  }
+  std::stringstream buf;
+  buf << in.rdbuf();
+  std::string json = buf.str();
+  const std::string name_key = "\"name\": \"";
+  const std::string analyze_key = "\"analyze\": {";
+  const std::string mean_key = "\"mean_us\": ";
+  size_t pos = 0;
+  while ((pos = json.find(name_key, pos)) != std::string::npos) {
+    pos += name_key.size();
+    size_t end = json.find('"', pos);
+    size_t analyze = json.find(analyze_key, end);
+    if (end == std::string::npos || analyze == std::string::npos) {
+      break;
+    }
+    size_t mean = json.find(mean_key, analyze);
+    if (mean == std::string::npos) {
+      break;
+    }
+    means[json.substr(pos, end - pos)] = atof(json.c_str() + mean + mean_key.size());
+    pos = mean;
+  }
+  return true;
+}
+
+static void print_comparison(const std::map<std::string, double>& baseline, const std::vector<Document>& docs,
+                             const std::vector<DocumentResult>& results) {
+  double before_total = 0;
+  double after_total = 0;
+  fprintf(stderr, "%-24s %12s %12s %8s\n", "document", "before us", "after us", "speedup");
+  for (size_t i = 0; i < docs.size(); i++) {
+    auto found = baseline.find(docs[i].name);
+    if (found == baseline.end() || results[i].analyze.mean_us <= 0) {
+      continue;
+    }
+    double before = found->second;
+    double after = results[i].analyze.mean_us;
+    before_total += before;
+    after_total += after;
+    fprintf(stderr, "%-24s %12.3f %12.3f %7.2fx\n", docs[i].name.c_str(), before, after, before / after);
+  }
+  if (after_total > 0) {
+    fprintf(stderr, "%-24s %12.3f %12.3f %7.2fx\n", "total", before_total, after_total, before_total / after_total);
+  }
+}
+
+int main(int argc, char** argv) {
+  double min_ms = 500;
+  std::string revision = "unknown";
+  const char* output = nullptr;
+  const char* compare = nullptr;
+  std::map<std::string, double> baseline;
+  std::vector<Document> docs;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:r:o:c:")) != -1) {
+    switch(opt) {
+    case 't':
+      min_ms = atof(optarg);
+      break;
+    case 'r':
+      revision = optarg;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'c':
+      compare = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t millis] [-r revision] [-o file] [-c baseline] path...\n", argv[0]);
+      return 2;
+    }
+  }
+  for (int i = optind; i < argc; i++) {
+    if (!load_path(argv[i], docs)) {
+      return 1;
+    }
+  }
+  if (docs.empty()) {
+    fprintf(stderr, "no documents\n");
+    return 1;
+  }
+  if (compare != nullptr && !load_baseline(compare, baseline)) {
+    return 1;
+  }
+
+  MarkdownParser parser((ParserConfig()));
+  std::vector<DocumentResult> results(docs.size());
+  for (size_t i = 0; i < docs.size(); i++) {
+    fprintf(stderr, "%s\n", docs[i].name.c_str());
+    results[i].hoedown = bench_hoedown(docs[i], min_ms * 1000);
+    bench_analyzer(parser, docs[i], min_ms * 1000, results[i]);
+  }
+
+  FILE* out = stdout;
+  if (output != nullptr) {
+    out = fopen(output, "w");
+    if (out == nullptr) {
+      fprintf(stderr, "%s: cannot write\n", output);
+      return 1;
+    }
+  }
+  print_results(out, revision, min_ms, docs, results);
+  if (out != stdout) {
+    fclose(out);
+  }
+  if (compare != nullptr) {
+    print_comparison(baseline, docs, results);
+  }
+  return 0;
+}
@@ -0,0 +1,265 @@
+// Algorithmic complexity checks for pathological inputs.
+//
+// Usage: gb_complexity [-s bytes] [-n steps] [-t millis] [-b bound] [case...]
+//   -s  smallest input size, default 16384
+//   -n  number of doublings measured, default 6
+//   -t  minimum measuring time per size, default 100
+//   -b  override every case's declared growth bound
+// Runs every case when none are named.
+//
+// Each case builds inputs of doubling size and measures render and release
+// time (the fastest of the runs) and peak native memory. The growth
+// exponent is the least squares slope of log(cost) over log(size); a case
+// fails when time or memory grows faster than its declared bound allows.
+// Exits 1 if any case fails.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gb_memory.hpp"
+#include "markdown_analyzer.hpp"
+#include "markdown_parser.hpp"
+
+using namespace greenbar;
+
+// Slack over the declared exponent for timer and cache noise. Superlinear
+// cases show up as n^1.5 and above.
+#define GROWTH_TOLERANCE 0.4
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Appends one unit of a case's input. Units are repeated up to the size.
+typedef void (*Generator)(std::string& out, size_t index);
+
+struct Case {
+  const char* name;
+  const char* description;
+  Generator generate;
+  // Declared growth exponent of time and memory in input size
+  double bound;
+};
+
+struct Sample {
+  size_t bytes;
+  size_t nodes;
+  double us;
+  int64_t peak_bytes;
+};
+
+// [[[[...x]]]] links nested as deep as the unit allows, repeated
+static void nested_brackets(std::string& out, size_t index) {
+  out.append(64, '[');
+  out.append("x");
+  out.append(64, ']');
+  out.append("(u) ");
+}
+
+// Unmatched emphasis delimiters in one paragraph
+static void emphasis_run(std::string& out, size_t index) {
+  out.append(index % 2 == 0 ? "a** " : "b__ ");
+}
+
+// Many spans in one paragraph, each folded in by the paragraph callback
+static void wide_paragraph(std::string& out, size_t index) {
+  out.append(index % 3 == 0 ? "*a* " : index % 3 == 1 ? "**b** " : "`c` ");
+}
+
+// Lists nested to GB_MAX_NESTING, one after another
+static void deep_list(std::string& out, size_t index) {
+  for (size_t depth = 0; depth < GB_MAX_NESTING; depth++) {
+    out.append(depth * 2, ' ');
+    out.append("- item *x*\n");
+  }
+  out.append("\n");
+}
+
+// One flat list of items with inline content
+static void long_list(std::string& out, size_t index) {
+  out.append("- item *x* and `y`\n");
+}
+
+// One table with inline markup in every cell, so rows go through hoedown
+// and the table cell callbacks rather than the plain table fast path
+static void inline_table(std::string& out, size_t index) {
+  if (index == 0) {
+    out.append("| a | b | c |\n|:--|:-:|--:|\n");
+  }
+  out.append("| *x* | **y** | `z` |\n");
+}
+
+// One table of plain text, built by the fast path
+static void plain_table(std::string& out, size_t index) {
+  if (index == 0) {
+    out.append("| a | b | c |\n|---|---|---|\n");
+  }
+  out.append("| one | two | three |\n");
+}
+
+// Code spans opened with ever longer backtick runs that never close
+static void backtick_runs(std::string& out, size_t index) {
+  out.append(1 + index % 32, '`');
+  out.append("a ");
+}
+
+// Link openers that are never closed
+static void open_links(std::string& out, size_t index) {
+  out.append("[a](b ");
+}
+
+static const Case cases[] = {
+  {"nested_brackets", "nested link brackets", nested_brackets, 1.0},
+  {"emphasis_run", "unmatched emphasis delimiters", emphasis_run, 1.0},
+  {"wide_paragraph", "spans in one paragraph", wide_paragraph, 1.0},
+  {"deep_list", "lists nested to GB_MAX_NESTING", deep_list, 1.0},
+  {"long_list", "items in one list", long_list, 1.0},
+  {"inline_table", "rows of a table with inline cells", inline_table, 1.0},
+  {"plain_table", "rows of a plain table", plain_table, 1.0},
+  {"backtick_runs", "unclosed backtick runs", backtick_runs, 1.0},
+  {"open_links", "unclosed link openers", open_links, 1.0},
+  {NULL, NULL, NULL, 0}
+};
+
+static std::string build_input(const Case& test, size_t size) {
+  std::string out;
+  out.reserve(size + 1024);
+  for (size_t index = 0; out.size() < size; index++) {
+    test.generate(out, index);
+  }
+  return out;
+}
+
+static double elapsed_us(bench_clock::time_point start, bench_clock::time_point end) {
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+static Sample measure(MarkdownParser& parser, const std::string& input, double min_us) {
+  const ParseLimits& limits = parser.config().limits;
+  const uint8_t* data = (const uint8_t*) input.data();
+  Sample sample;
+  sample.bytes = input.size();
+  sample.us = 0;
+
+  // One measured pass for memory, released within the call
+  memory::begin_call();
+  auto doc = parser.acquire();
+  parser.render(doc, data, input.size(), limits);
+  sample.nodes = get_limits(doc->analyzer)->node_count();
+  parser.release(doc);
+  sample.peak_bytes = memory::end_call().peak;
+
+  double total = 0;
+  size_t runs = 0;
+  while (total < min_us || runs < 3) {
+    doc = parser.acquire();
+    auto start = bench_clock::now();
+    parser.render(doc, data, input.size(), limits);
+    parser.release(doc);
+    double us = elapsed_us(start, bench_clock::now());
+    sample.us = runs == 0 ? us : std::min(sample.us, us);
+    total += us;
+    runs++;
+  }
+  return sample;
+}
+
+// Least squares slope of log(value) over log(bytes)
+template <class F>
+static double growth(const std::vector<Sample>& samples, F value) {
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  size_t n = 0;
+  for (auto& sample : samples) {
+    double v = value(sample);
+    if (v <= 0) {
+      continue;
+    }
+    double x = log((double) sample.bytes);
+    double y = log(v);
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+    n++;
+  }
+  double d = n * sxx - sx * sx;
+  return n < 2 || d == 0 ? 0 : (n * sxy - sx * sy) / d;
+}
+
+static bool run_case(MarkdownParser& parser, const Case& test, size_t smallest, size_t steps, double min_us,
+                     double bound) {
+  std::vector<Sample> samples;
+  printf("%s: %s\n", test.name, test.description);
+  printf("  %10s %9s %12s %12s\n", "bytes", "nodes", "us", "peak KB");
+  for (size_t step = 0; step < steps; step++) {
+    auto input = build_input(test, smallest << step);
+    auto sample = measure(parser, input, min_us);
+    printf("  %10zu %9zu %12.1f %12.1f\n", sample.bytes, sample.nodes, sample.us, sample.peak_bytes / 1024.0);
+    samples.push_back(sample);
+  }
+  double time_growth = growth(samples, [](const Sample& s) { return s.us; });
+  double memory_growth = growth(samples, [](const Sample& s) { return (double) s.peak_bytes; });
+  bool ok = time_growth <= bound + GROWTH_TOLERANCE && memory_growth <= bound + GROWTH_TOLERANCE;
+  printf("  time n^%.2f, memory n^%.2f, bound n^%.2f: %s\n\n", time_growth, memory_growth, bound,
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  size_t smallest = 16384;
+  size_t steps = 6;
+  double min_ms = 100;
+  double bound = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:n:t:b:")) != -1) {
+    switch(opt) {
+    case 's':
+      smallest = strtoul(optarg, NULL, 10);
+      break;
+    case 'n':
+      steps = strtoul(optarg, NULL, 10);
+      break;
+    case 't':
+      min_ms = atof(optarg);
+      break;
+    case 'b':
+      bound = atof(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s bytes] [-n steps] [-t millis] [-b bound] [case...]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (smallest == 0 || steps < 2) {
+    fprintf(stderr, "need a size and at least 2 steps\n");
+    return 2;
+  }
+
+  MarkdownParser parser((ParserConfig()));
+  size_t failed = 0;
+  size_t ran = 0;
+  for (size_t i = 0; cases[i].name != NULL; i++) {
+    bool selected = optind == argc;
+    for (int arg = optind; arg < argc; arg++) {
+      selected = selected || strcmp(argv[arg], cases[i].name) == 0;
+    }
+    if (!selected) {
+      continue;
+    }
+    ran++;
+    if (!run_case(parser, cases[i], smallest, steps, min_ms * 1000, bound > 0 ? bound : cases[i].bound)) {
+      failed++;
+    }
+  }
+  if (ran == 0) {
+    fprintf(stderr, "no such case\n");
+    return 2;
+  }
+  printf("%zu of %zu cases within bounds\n", ran - failed, ran);
+  return failed == 0 ? 0 : 1;
+}
@@ -1,7 +1,70 @@
 #ifndef GREENBAR_COMMON_H
 #define GREENBAR_COMMON_H
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "gb_ring.hpp"
+#include "markdown_parser.hpp"
+#include "gb_slowlog.hpp"
+#include "gb_stats.hpp"
+
+// Identifies private data a code upgrade can take state over from.
+// Bump GB_PRIV_VERSION whenever gb_priv_s, gb_parser_res, ParserConfig,
+// StatsSnapshot or the slow log structs change layout.
+#define GB_PRIV_MAGIC 0x47425056
+#define GB_PRIV_VERSION 9
+
+// Parser handle resource. Parsers hold hoedown callbacks into the library
+// instance that built them, so a handle taken over by an upgraded instance
+// is rebuilt from its config on first use.
 typedef struct {
+  std::atomic<greenbar::MarkdownParser*> parser;
+  // Generation of the library instance that built parser
+  std::atomic<uint32_t> generation;
+  greenbar::ParserConfig config;
+} gb_parser_res;
+
+// Shared memory a gb_worker process parses from. Only the owning
+// greenbar_markdown_worker uses it, the lock keeps a leaked handle safe.
+typedef struct {
+  greenbar::RingSegment segment;
+  std::mutex lock;
+  // Shared memory object name, empty once there's nothing to unlink
+  char name[32];
+} gb_ring_res;
+
+typedef struct gb_priv_s {
+  // Checked by on_upgrade before anything else is read
+  uint32_t magic;
+  uint32_t version;
+  // Counts code upgrades since the first load
+  uint32_t generation;
+  // Serializes handle rebuilds across library instances. Shared with and
+  // handed over to the next instance on upgrade.
+  ErlNifMutex* handle_lock;
+  // Upgraded instance that took over this one's state, or NULL. It stays
+  // loaded at least until this instance unloads.
+  gb_priv_s* successor;
+  // Stats the successor took over, and when. This instance keeps serving
+  // old code until it is purged, and passes on what it records meanwhile.
+  greenbar::StatsSnapshot handoff_stats;
+  int64_t handoff_ms;
+  // Reads this instance's stats, callable while the instance is loaded
+  void (*export_stats)(greenbar::StatsSnapshot* out);
+  // Adds stats recorded by a predecessor to this instance's
+  void (*absorb_stats)(const greenbar::StatsSnapshot& totals);
+  // Reads this instance's slow parse log
+  void (*export_slow_log)(greenbar::SlowLogConfig* config, std::vector<greenbar::SlowParse>* entries);
+  // Offers slow parses recorded by a predecessor to this instance's log
+  void (*merge_slow_log)(const std::vector<greenbar::SlowParse>& entries);
+  ErlNifResourceType* gb_parser_type;
+  ErlNifResourceType* gb_ring_type;
+  // Serves parse/1 and parse/2 calls that don't need their own documents
+  greenbar::MarkdownParser* default_parser;
+  // Serves {output, html} calls with the default extensions
+  greenbar::MarkdownParser* html_parser;
   ERL_NIF_TERM gb_atom_ok;
   ERL_NIF_TERM gb_atom_error;
   ERL_NIF_TERM gb_atom_out_of_memory;
@@ -16,6 +79,7 @@ typedef struct {
   ERL_NIF_TERM gb_atom_header;
   ERL_NIF_TERM gb_atom_italics;
   ERL_NIF_TERM gb_atom_bold;
+  ERL_NIF_TERM gb_atom_strikethrough;
   ERL_NIF_TERM gb_atom_link;
   ERL_NIF_TERM gb_atom_level;
   ERL_NIF_TERM gb_atom_url;
@@ -30,6 +94,46 @@ typedef struct {
   ERL_NIF_TERM gb_atom_left;
   ERL_NIF_TERM gb_atom_right;
   ERL_NIF_TERM gb_atom_center;
+  ERL_NIF_TERM gb_atom_limit_exceeded;
+  ERL_NIF_TERM gb_atom_input_size;
+  ERL_NIF_TERM gb_atom_nodes;
+  ERL_NIF_TERM gb_atom_nesting;
+  ERL_NIF_TERM gb_atom_timeout;
+  ERL_NIF_TERM gb_atom_max_input_size;
+  ERL_NIF_TERM gb_atom_max_nodes;
+  ERL_NIF_TERM gb_atom_max_nesting;
+  ERL_NIF_TERM gb_atom_extensions;
+  ERL_NIF_TERM gb_atom_output;
+  ERL_NIF_TERM gb_atom_tree;
+  ERL_NIF_TERM gb_atom_pool_size;
+  ERL_NIF_TERM gb_atom_greenbar_parser;
+  ERL_NIF_TERM gb_atom_none;
+  ERL_NIF_TERM gb_atom_alignments;
+  ERL_NIF_TERM gb_atom_rows;
+  ERL_NIF_TERM gb_atom_row_batches;
+  ERL_NIF_TERM gb_atom_tables;
+  ERL_NIF_TERM gb_atom_columnar;
+  ERL_NIF_TERM gb_atom_table_batch_size;
+  ERL_NIF_TERM gb_atom_calls;
+  ERL_NIF_TERM gb_atom_input_bytes;
+  ERL_NIF_TERM gb_atom_errors;
+  ERL_NIF_TERM gb_atom_limits;
+  ERL_NIF_TERM gb_atom_pool;
+  ERL_NIF_TERM gb_atom_hits;
+  ERL_NIF_TERM gb_atom_misses;
+  ERL_NIF_TERM gb_atom_parse_us;
+  ERL_NIF_TERM gb_atom_convert_us;
+  ERL_NIF_TERM gb_atom_infinity;
+  ERL_NIF_TERM gb_atom_memory;
+  ERL_NIF_TERM gb_atom_peak_kb;
+  ERL_NIF_TERM gb_atom_intern_strings;
+  ERL_NIF_TERM gb_atom_true;
+  ERL_NIF_TERM gb_atom_false;
+  ERL_NIF_TERM gb_atom_html;
+  ERL_NIF_TERM gb_atom_json;
+  ERL_NIF_TERM gb_atom_normalize_whitespace;
+  ERL_NIF_TERM gb_atom_page_bytes;
+  ERL_NIF_TERM gb_atom_pages;
 } gb_priv_s;
 
 #endif
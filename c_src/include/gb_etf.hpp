@@ -0,0 +1,36 @@
+#ifndef GREENBAR_ETF_H
+#define GREENBAR_ETF_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "buffer.h"
+#include "markdown_parser.hpp"
+#include "md_node_base.hpp"
+#include "parse_limits.hpp"
+#include "parse_profile.hpp"
+
+namespace greenbar {
+
+  // Writers for Erlang's external term format, enough to build results
+  // binary_to_term/1 reads back without erl_interface
+  namespace etf {
+    // Starts a term
+    void put_version(hoedown_buffer* out);
+    void put_atom(hoedown_buffer* out, const char* name);
+    void put_tuple(hoedown_buffer* out, size_t arity);
+    void put_binary(hoedown_buffer* out, const uint8_t* data, size_t size);
+    void put_integer(hoedown_buffer* out, int32_t value);
+    // {error, limit_exceeded, Which}
+    void put_limit_error(hoedown_buffer* out, LimitType which);
+  }
+
+  // Appends the collector to out as the list analyze/2 returns, in the same
+  // order and with the same maps node_to_term builds. Fixed-width blocks are
+  // never paged. Returns false when a limit trips part way through.
+  bool collector_to_etf(hoedown_buffer* out, node2::NodeVector* collector, LimitTracker* limits,
+                        const ParserConfig& config, ParseProfile* profile = nullptr);
+
+}
+
+#endif
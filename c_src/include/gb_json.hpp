@@ -0,0 +1,30 @@
+#ifndef GREENBAR_JSON_H
+#define GREENBAR_JSON_H
+
+#include "buffer.h"
+#include "markdown_parser.hpp"
+#include "md_node_base.hpp"
+#include "parse_limits.hpp"
+#include "parse_profile.hpp"
+
+namespace greenbar {
+
+  // Names of the atoms type_to_atom and alignment_to_atom return
+  const char* node_type_name(node2::NodeType type);
+  const char* node_alignment_name(int align);
+
+  // Appends data to out as a JSON string, escaped as collector_to_json does
+  void put_json_string(hoedown_buffer* out, const uint8_t* data, size_t size);
+
+  // Appends the collector to out as a JSON array in the order analyze/2
+  // returns it. Each node is an object with the keys of the map node_to_term
+  // builds, atoms written as strings and tuples as arrays. Text is copied
+  // byte for byte apart from escapes, with bytes of malformed UTF-8
+  // replaced by \ufffd.
+  // Returns false when a limit trips part way through.
+  bool collector_to_json(hoedown_buffer* out, node2::NodeVector* collector, LimitTracker* limits,
+                         const ParserConfig& config, ParseProfile* profile = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef GREENBAR_MEMORY_H
+#define GREENBAR_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Inputs up to this size, typically chat messages, parse with their nodes
+// in the per-thread arena, see memory::begin_arena
+#define GB_SMALL_INPUT 1024
+
+namespace greenbar {
+
+  // Backing functions for native allocations
+  struct Allocator {
+    void* (*alloc)(size_t size);
+    void* (*realloc)(void* ptr, size_t size);
+    void (*free)(void* ptr);
+  };
+
+  // Process wide totals. Threads publish their counts in batches so
+  // current and peak may trail by GB_MEMORY_FLUSH bytes per thread.
+  struct MemoryTotals {
+    int64_t current;
+    int64_t peak;
+    uint64_t allocated;
+    uint64_t allocations;
+    // Highest peak of a single parse
+    uint64_t largest_call_peak;
+  };
+
+  // Memory used by one parse on the calling thread
+  struct CallMemory {
+    int64_t current;
+    int64_t peak;
+    uint64_t allocated;
+  };
+
+  // Every native allocation made by the analyzer, its nodes and, where the
+  // build renames hoedown's malloc calls, hoedown goes through here. Each
+  // block records its size and allocator so it can be freed after the
+  // allocator is replaced.
+  namespace memory {
+    // Use allocator for new allocations, or the C library with nullptr.
+    // allocator must outlive every block it allocates.
+    void set_allocator(const Allocator* allocator);
+
+    void* allocate(size_t size);
+    void* reallocate(void* ptr, size_t size);
+    void release(void* ptr);
+
+    // Serve allocate_node calls on this thread from a fixed per-thread
+    // buffer until end_arena, falling back to allocate once it is full.
+    // Arena blocks are neither counted nor freed one by one, so everything
+    // allocated from the arena must be released before end_arena.
+    void begin_arena();
+    void end_arena();
+
+    // Allocation for nodes and their text, which live no longer than a parse
+    void* allocate_node(size_t size);
+
+    // Start measuring a parse on this thread
+    void begin_call();
+    // Stop measuring and return what the parse used
+    CallMemory end_call();
+
+    MemoryTotals totals();
+  }
+
+  // STL allocator over memory::allocate for containers owned by nodes
+  template <class T>
+  struct TrackedAllocator {
+    typedef T value_type;
+
+    TrackedAllocator() { }
+    template <class U> TrackedAllocator(const TrackedAllocator<U>&) { }
+
+    T* allocate(size_t n) {
+      if (n > SIZE_MAX / sizeof(T)) {
+        throw std::bad_alloc();
+      }
+      void* ptr = memory::allocate(n * sizeof(T));
+      if (ptr == nullptr) {
+        throw std::bad_alloc();
+      }
+      return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t) {
+      memory::release(ptr);
+    }
+  };
+
+  template <class T, class U>
+  bool operator==(const TrackedAllocator<T>&, const TrackedAllocator<U>&) { return true; }
+
+  template <class T, class U>
+  bool operator!=(const TrackedAllocator<T>&, const TrackedAllocator<U>&) { return false; }
+
+  // STL allocator over memory::allocate_node for node text and attributes
+  template <class T>
+  struct NodeAllocator {
+    typedef T value_type;
+
+    NodeAllocator() { }
+    template <class U> NodeAllocator(const NodeAllocator<U>&) { }
+
+    T* allocate(size_t n) {
+      if (n > SIZE_MAX / sizeof(T)) {
+        throw std::bad_alloc();
+      }
+      void* ptr = memory::allocate_node(n * sizeof(T));
+      if (ptr == nullptr) {
+        throw std::bad_alloc();
+      }
+      return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t) {
+      memory::release(ptr);
+    }
+  };
+
+  template <class T, class U>
+  bool operator==(const NodeAllocator<T>&, const NodeAllocator<U>&) { return true; }
+
+  template <class T, class U>
+  bool operator!=(const NodeAllocator<T>&, const NodeAllocator<U>&) { return false; }
+
+}
+
+#endif
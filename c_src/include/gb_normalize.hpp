@@ -0,0 +1,20 @@
+#ifndef GREENBAR_NORMALIZE_H
+#define GREENBAR_NORMALIZE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "buffer.h"
+
+namespace greenbar {
+
+  // Copies data into out with CRLF line endings made LF, trailing spaces and
+  // tabs removed and runs of blank lines cut to one. Two trailing spaces are
+  // kept since they make a hard line break, and fenced code keeps its lines
+  // as they are. Returns false when data is already normal, in which case
+  // out shouldn't be used.
+  bool normalize_whitespace(const uint8_t* data, size_t size, hoedown_buffer* out);
+
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef GREENBAR_RING_H
+#define GREENBAR_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Identifies a segment laid out by this version of the ring code
+#define GB_RING_MAGIC 0x47425247
+#define GB_RING_VERSION 1
+
+// Smallest ring, in bytes
+#define GB_RING_MIN_BYTES 4096
+
+// Record flag sending the reader back to the start of the ring
+#define GB_RING_SKIP 1
+
+namespace greenbar {
+
+  // Every record starts with this header on a 16 byte boundary. Records
+  // never wrap, so payloads can be read and written in place.
+  struct RingRecord {
+    uint32_t size;
+    uint32_t flags;
+    uint64_t id;
+  };
+
+  // Shared positions of one ring. Both count bytes since the segment was
+  // created; each is written by one side only.
+  struct RingControl {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) uint64_t capacity;
+  };
+
+  // Single producer, single consumer queue of records in shared memory.
+  // Each process keeps its own view of a ring.
+  class SharedRing {
+  private:
+    RingControl* control_;
+    uint8_t* data_;
+    // Checked copy of control_->capacity. Nothing the other side writes is
+    // trusted to stay in bounds.
+    uint64_t capacity_;
+    // Bytes skipped at the end of the ring by the pending reserve
+    uint64_t skip_;
+    // Bytes of the record returned by the last peek
+    uint64_t peeked_;
+  public:
+    SharedRing() : control_(nullptr), data_(nullptr), capacity_(0), skip_(0), peeked_(0) { }
+
+    void bind(RingControl* control, uint8_t* data, uint64_t capacity) {
+      control_ = control;
+      data_ = data;
+      capacity_ = capacity;
+    }
+
+    // Largest payload that always fits once the consumer catches up
+    size_t max_payload() const { return capacity_ / 2 - sizeof(RingRecord); }
+
+    // Producer: room for a payload of size bytes, nullptr while the ring is
+    // too full. Nothing is visible to the consumer before commit.
+    uint8_t* reserve(size_t size);
+    void commit(size_t size, uint64_t id);
+
+    // Consumer: the oldest record, false when the ring is empty. The payload
+    // stays valid until release. Records a misbehaving producer left out of
+    // bounds are dropped along with everything after them.
+    bool peek(RingRecord* record, const uint8_t** payload);
+    void release();
+  };
+
+  // Mapped shared memory holding a request ring and a response ring
+  struct RingSegment {
+    void* base;
+    size_t size;
+    SharedRing requests;
+    SharedRing responses;
+    RingSegment() : base(nullptr), size(0) { }
+  };
+
+  namespace ring {
+    // Creates and maps a new POSIX shared memory object with two rings of
+    // ring_bytes each. Returns 0 or an errno value; EEXIST if name is taken.
+    int create(const char* name, size_t ring_bytes, RingSegment* segment);
+
+    // Maps a segment made by create and removes its name, so it goes away
+    // with the last process mapping it. Returns 0 or an errno value, EPROTO
+    // when the segment has another layout.
+    int attach(const char* name, RingSegment* segment);
+
+    void unmap(RingSegment* segment);
+  }
+
+}
+
+#endif
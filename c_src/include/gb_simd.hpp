@@ -0,0 +1,47 @@
+#ifndef GREENBAR_SIMD_H
+#define GREENBAR_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace greenbar {
+  namespace simd {
+
+    // Up to 16 bytes searched for in a single pass
+    class ByteSet {
+    private:
+      uint8_t chars_[16];
+      size_t count_;
+      bool table_[256];
+    public:
+      ByteSet();
+      // Returns false when the set is full
+      bool add(uint8_t c);
+      bool contains(uint8_t c) const { return table_[c]; }
+      size_t count() const { return count_; }
+      const uint8_t* chars() const { return chars_; }
+    };
+
+    // Offset of the first c in data, or size if there is none
+    size_t find_byte(const uint8_t* data, size_t size, uint8_t c);
+
+    // Offset of the first byte of data in set, or size if there is none
+    size_t find_first_of(const uint8_t* data, size_t size, const ByteSet& set);
+
+    // Offset of the first byte JSON strings must escape (control
+    // characters, '"' and '\\') or check (bytes of multi-byte UTF-8
+    // sequences), or size if there is none
+    size_t find_json_escape(const uint8_t* data, size_t size);
+
+    // Offset of the first byte whitespace normalization may change: a '\r',
+    // a space or tab ending a line or the data, or a third '\n' in a row.
+    // size if there is none.
+    size_t find_line_fixup(const uint8_t* data, size_t size);
+
+    // Number of times c occurs in data
+    size_t count_byte(const uint8_t* data, size_t size, uint8_t c);
+
+  }
+}
+
+#endif
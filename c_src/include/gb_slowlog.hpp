@@ -0,0 +1,67 @@
+#ifndef GREENBAR_SLOWLOG_H
+#define GREENBAR_SLOWLOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "parse_limits.hpp"
+
+// Largest input prefix kept with an entry
+#define GB_SLOW_SAMPLE_MAX 4096
+
+namespace greenbar {
+
+  struct SlowLogConfig {
+    // Parses taking at least this long are kept, 0 disables the log
+    uint64_t threshold_us;
+    // Entries kept; once full a slower parse replaces the fastest entry
+    size_t capacity;
+    // Leading input bytes kept with each entry, up to GB_SLOW_SAMPLE_MAX
+    size_t sample_bytes;
+    SlowLogConfig() : threshold_us(10000), capacity(32), sample_bytes(0) { }
+  };
+
+  struct SlowParse {
+    uint64_t duration_us;
+    uint64_t render_us;
+    size_t bytes;
+    size_t nodes;
+    // Limit that stopped the parse, LIMIT_NONE if it finished
+    LimitType limit;
+    // FNV-1a of the whole input
+    uint64_t hash;
+    // Wall clock time of the parse in milliseconds since the epoch
+    int64_t at_ms;
+    std::string sample;
+  };
+
+  // The slowest parses over a threshold since the log was configured,
+  // shared by every thread. Parses under the threshold, or no slower than
+  // every entry of a full log, only pay for two relaxed loads.
+  namespace slowlog {
+    // Replaces the config and clears the log
+    void configure(const SlowLogConfig& config);
+    SlowLogConfig config();
+
+    // True if a parse of this duration would be kept
+    bool wants(uint64_t duration_us);
+    void record(const uint8_t* data, size_t size, uint64_t duration_us, uint64_t render_us, size_t nodes,
+                LimitType limit);
+
+    // Kept entries, slowest first
+    void entries(std::vector<SlowParse>* out);
+
+    // Config and entries carried over from another instance, e.g. across a
+    // code upgrade
+    void restore(const SlowLogConfig& config, const std::vector<SlowParse>& entries);
+
+    // Offers entries another instance recorded to this log under its own
+    // config. Entries the log already holds are skipped.
+    void merge(const std::vector<SlowParse>& entries);
+  }
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef GREENBAR_STATS_H
+#define GREENBAR_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "md_node_base.hpp"
+
+// Log2 buckets, the last one is open ended
+#define GB_HISTOGRAM_BUCKETS 24
+
+// Slots for every NodeType value
+#define GB_NODE_TYPES (greenbar::node2::MD_TABLE - greenbar::node2::MD_NONE + 1)
+
+namespace greenbar {
+
+  // Cumulative counters. Values are array indices.
+  enum StatCounter {
+    STAT_CALLS = 0,
+    STAT_INPUT_BYTES,
+    STAT_ERRORS,
+    STAT_LIMIT_INPUT_SIZE,
+    STAT_LIMIT_NODES,
+    STAT_LIMIT_NESTING,
+    STAT_LIMIT_TIMEOUT,
+    STAT_POOL_HITS,
+    STAT_POOL_MISSES,
+    STAT_COUNTER_COUNT
+  };
+
+  // Histograms. Values are array indices.
+  enum StatHistogram {
+    HIST_PARSE_US = 0,
+    HIST_CONVERT_US,
+    // Peak native memory of each parse in KB
+    HIST_PEAK_KB,
+    HIST_COUNT
+  };
+
+  // Totals across all threads at the time of the read
+  struct StatsSnapshot {
+    uint64_t counters[STAT_COUNTER_COUNT];
+    uint64_t nodes[GB_NODE_TYPES];
+    uint64_t histograms[HIST_COUNT][GB_HISTOGRAM_BUCKETS];
+  };
+
+  // Each thread records into its own block so recording never contends.
+  // Reads sum every live block plus the totals of exited threads.
+  namespace stats {
+    void add(StatCounter counter, uint64_t n = 1);
+    void add_node(node2::NodeType type);
+    void record(StatHistogram histogram, uint64_t value);
+    void snapshot(StatsSnapshot* out);
+    // Adds totals carried over from another instance, e.g. across a code upgrade
+    void absorb(const StatsSnapshot& totals);
+    // Leaves in totals only what was recorded since earlier, a previous
+    // snapshot of the same instance
+    void subtract(StatsSnapshot* totals, const StatsSnapshot& earlier);
+    // Exclusive upper bound of a histogram bucket, 0 for the open last bucket
+    uint64_t bucket_limit(size_t bucket);
+  }
+
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef GREENBAR_TERM_BUILDER_H
+#define GREENBAR_TERM_BUILDER_H
+
+#include <cstring>
+#include <unordered_map>
+
+#include "erl_nif.h"
+#include "gb_common.hpp"
+#include "gb_memory.hpp"
+#include "md_node_base.hpp"
+#include "markdown_parser.hpp"
+#include "parse_limits.hpp"
+#include "parse_profile.hpp"
+
+namespace greenbar {
+
+  // Longest text shared through a StringTable. Repeated values in command
+  // output are short; hashing long unique text would only cost time.
+  #define GB_INTERN_MAX_SIZE 256
+
+  // Borrowed node text, valid for the duration of a conversion
+  struct TextKey {
+    const char* data;
+    size_t size;
+    bool operator==(const TextKey& other) const {
+      return size == other.size && memcmp(data, other.data, size) == 0;
+    }
+  };
+
+  struct TextKeyHash {
+    size_t operator()(const TextKey& key) const {
+      // FNV-1a
+      uint64_t hash = 14695981039346656037ULL;
+      for (size_t i = 0; i < key.size; i++) {
+        hash = (hash ^ (uint8_t) key.data[i]) * 1099511628211ULL;
+      }
+      return (size_t) hash;
+    }
+  };
+
+  // Binaries already made during one conversion, keyed by their text
+  typedef std::unordered_map<TextKey, ERL_NIF_TERM, TextKeyHash, std::equal_to<TextKey>,
+                             TrackedAllocator<std::pair<const TextKey, ERL_NIF_TERM> > > StringTable;
+
+  // State shared by a single tree to term conversion
+  struct TermContext {
+    ErlNifEnv* env;
+    gb_priv_s* priv_data;
+    LimitTracker* limits;
+    TableFormat tables;
+    // Rows per batch for columnar tables, 0 for a single list
+    size_t table_batch_size;
+    // Receives result node counts when the parse is profiled
+    ParseProfile* profile;
+    // Shares identical text between terms when set
+    StringTable* strings;
+    // Byte budget of fixed-width block pages, 0 to leave blocks whole
+    size_t page_bytes;
+  };
+
+  ERL_NIF_TERM type_to_atom(node2::NodeType type, gb_priv_s* priv_data);
+  ERL_NIF_TERM alignment_to_atom(node2::NodeAlignment align, gb_priv_s* priv_data);
+
+  // Convert a node and its children to a map term
+  ERL_NIF_TERM node_to_term(TermContext& ctx, node2::MarkdownNode* node);
+
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef GREENBAR_TRACE_H
+#define GREENBAR_TRACE_H
+
+// USDT probes under the greenbar provider, e.g.
+//   bpftrace -e 'usdt:priv/greenbar_markdown.so:greenbar:parse_done { @us = hist(arg2); }'
+// Without sys/sdt.h they compile to nothing. With it each probe is a
+// single nop until a tracer attaches; arguments are values the parse
+// computes anyway.
+
+#ifdef GB_HAVE_SDT
+#include <sys/sdt.h>
+#define GB_PROBE1(name, a) DTRACE_PROBE1(greenbar, name, a)
+#define GB_PROBE2(name, a, b) DTRACE_PROBE2(greenbar, name, a, b)
+#define GB_PROBE3(name, a, b, c) DTRACE_PROBE3(greenbar, name, a, b, c)
+#else
+#define GB_PROBE1(name, a) do { } while (0)
+#define GB_PROBE2(name, a, b) do { } while (0)
+#define GB_PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+// Input gathered: input bytes
+#define GB_TRACE_PARSE_START(size) GB_PROBE1(parse_start, size)
+// hoedown finished: input bytes, nodes analyzed, render microseconds
+#define GB_TRACE_RENDER_DONE(size, nodes, us) GB_PROBE3(render_done, size, nodes, us)
+// Terms built: nodes analyzed, conversion microseconds
+#define GB_TRACE_CONVERT_DONE(nodes, us) GB_PROBE2(convert_done, nodes, us)
+// Parse returned a result: input bytes, nodes analyzed, render plus conversion microseconds
+#define GB_TRACE_PARSE_DONE(size, nodes, us) GB_PROBE3(parse_done, size, nodes, us)
+// Limit exceeded: LimitType value, input bytes, nodes analyzed
+#define GB_TRACE_LIMIT(which, size, nodes) GB_PROBE3(limit_exceeded, which, size, nodes)
+// Call failed before parsing: reason string
+#define GB_TRACE_ERROR(reason) GB_PROBE1(parse_error, reason)
+
+#endif
@@ -3,9 +3,20 @@
 
 #include "document.h"
 #include "md_node.hpp"
+#include "parse_limits.hpp"
+#include "parse_profile.hpp"
+#include "pipe_table.hpp"
 
 typedef hoedown_renderer markdown_analyzer;
 
+#define GB_HOEDOWN_EXTENSIONS (hoedown_extensions) (HOEDOWN_EXT_DISABLE_INDENTED_CODE | HOEDOWN_EXT_SPACE_HEADERS | \
+                                                    HOEDOWN_EXT_MATH_EXPLICIT | HOEDOWN_EXT_NO_INTRA_EMPHASIS | \
+                                                    HOEDOWN_EXT_TABLES | HOEDOWN_EXT_FENCED_CODE)
+#define GB_MAX_NESTING 16
+// hoedown recurses once per level on the calling thread's stack, so the
+// depth it is given never exceeds this whatever max_nesting asks for
+#define GB_HOEDOWN_NESTING_CEILING 64
+
 namespace greenbar {
 
   // Create a new Markdown analyzer
@@ -17,8 +28,39 @@ namespace greenbar {
   // Get collector associated with analyzer instance
   greenbar::node2::NodeVector* get_collector(markdown_analyzer* analyzer);
 
+  // Free all nodes held by the analyzer's collector so it can be reused
+  void clear_collector(markdown_analyzer* analyzer);
+
+  // Get limit tracker associated with analyzer instance
+  LimitTracker* get_limits(markdown_analyzer* analyzer);
+
+  // Attach a profile to fill in during renders, or detach it with nullptr
+  void set_profile(markdown_analyzer* analyzer, ParseProfile* profile);
+
+  // Takes ownership of a finished top-level node
+  typedef void (*BlockSink)(void* ctx, node2::MarkdownNode* node);
+
+  // Pass top-level nodes to sink, in document order, as soon as no later
+  // block can fold them into its own, or stop with nullptr. ob is the buffer
+  // the document renders into. Nodes left in the collector after the render
+  // are final too and stay for the caller.
+  void set_block_sink(markdown_analyzer* analyzer, const hoedown_buffer* ob, BlockSink sink, void* ctx);
+
   // Prepare a hoedown document for processing with specified analyzer
   hoedown_document* new_hoedown_document(markdown_analyzer* analyzer);
+
+  // Prepare a hoedown document whose recursion budget covers max_nesting tree levels
+  hoedown_document* new_hoedown_document(markdown_analyzer* analyzer, size_t max_nesting);
+
+  // Prepare a hoedown document with a custom extension set
+  hoedown_document* new_hoedown_document(markdown_analyzer* analyzer, unsigned int extensions, size_t max_nesting);
+
+  // True when a table built directly wouldn't be absorbed by preceding nodes
+  bool accepts_table(markdown_analyzer* analyzer);
+
+  // Add a table found by PipeTableScanner to the collector, producing
+  // the same nodes hoedown's table callbacks would
+  void build_table(markdown_analyzer* analyzer, const uint8_t* text, const PipeTable& table);
 }
 
 #endif
@@ -0,0 +1,122 @@
+#ifndef GREENBAR_MARKDOWN_PARSER_H
+#define GREENBAR_MARKDOWN_PARSER_H
+
+#include <mutex>
+#include <vector>
+#include "buffer.h"
+#include "html.h"
+#include "gb_memory.hpp"
+#include "markdown_analyzer.hpp"
+#include "parse_limits.hpp"
+
+namespace greenbar {
+
+  // Shape of parse results
+  enum OutputFormat {
+    OUTPUT_TREE = 400,
+    // One binary of HTML from hoedown's own renderer, for previews
+    OUTPUT_HTML,
+    // The node tree written straight to one binary of JSON
+    OUTPUT_JSON
+  };
+
+  // Table term layouts
+  enum TableFormat {
+    TABLES_TREE = 500,
+    // Header, alignment and row tuples of cell text when every cell is plain text
+    TABLES_COLUMNAR
+  };
+
+  // hoedown flag of an extension name accepted by the extensions option.
+  // Returns false for unknown names.
+  bool extension_flag(const char* name, unsigned int* flag);
+
+  // Renderer configuration shared by every parse made through a parser
+  struct ParserConfig {
+    unsigned int extensions;
+    ParseLimits limits;
+    OutputFormat output;
+    TableFormat tables;
+    size_t table_batch_size;
+    // Build repeated text as one shared binary
+    bool intern_strings;
+    // Clean up line endings, trailing whitespace and blank line runs before rendering
+    bool normalize_whitespace;
+    // Byte budget of the pages fixed-width blocks are split into, 0 for none
+    size_t page_bytes;
+    // Maximum number of idle documents kept for reuse
+    size_t pool_size;
+    ParserConfig() : extensions(GB_HOEDOWN_EXTENSIONS), output(OUTPUT_TREE), tables(TABLES_TREE),
+                     table_batch_size(0), intern_strings(false), normalize_whitespace(false),
+                     page_bytes(0), pool_size(8) { }
+  };
+
+  // Analyzer and hoedown document ready for rendering. HTML documents render
+  // through hoedown's HTML renderer into ob and have no analyzer.
+  struct PooledDocument {
+    markdown_analyzer* analyzer;
+    hoedown_renderer* html;
+    hoedown_document* document;
+    hoedown_buffer* ob;
+    // Scratch space for coalescing fragmented input
+    hoedown_buffer* input;
+    // Normalized copy of the input, only for parsers normalizing whitespace
+    hoedown_buffer* normalized;
+  };
+
+  // Configured parser with a pool of ready documents.
+  // Safe to share between threads; each document is used by one parse at a time.
+  class MarkdownParser {
+  private:
+    // No copying
+    MarkdownParser(MarkdownParser const &);
+    MarkdownParser &operator=(MarkdownParser const &);
+
+    ParserConfig config_;
+    std::mutex lock_;
+    std::vector<PooledDocument*, TrackedAllocator<PooledDocument*> > idle_;
+
+    PooledDocument* new_document();
+    void free_document(PooledDocument* doc);
+  public:
+    MarkdownParser(const ParserConfig& config);
+    ~MarkdownParser();
+
+    // Parsers live in native memory like the documents they pool
+    static void* operator new(size_t size) {
+      void* ptr = memory::allocate(size);
+      if (ptr == nullptr) {
+        throw std::bad_alloc();
+      }
+      return ptr;
+    }
+    static void operator delete(void* ptr) { memory::release(ptr); }
+
+    const ParserConfig& config() { return config_; }
+
+    // True if documents from this parser can render with the other config
+    bool same_document(const ParserConfig& other);
+
+    // Take a document from the pool, creating one if the pool is empty.
+    // Returns nullptr when out of memory.
+    PooledDocument* acquire();
+
+    // Clear a document's results and return it to the pool
+    void release(PooledDocument* doc);
+
+    // Number of documents waiting in the pool
+    size_t idle();
+
+    // Fill the pool up to count documents, capped at pool_size.
+    // Returns the number of idle documents afterwards.
+    size_t warm(size_t count);
+
+    // Render input into the document's collector, tracking the given limits.
+    // A profile, when given, receives the render's timing, callbacks and allocations.
+    void render(PooledDocument* doc, const uint8_t* data, size_t size, const ParseLimits& limits,
+                ParseProfile* profile = nullptr);
+  };
+
+}
+
+#endif
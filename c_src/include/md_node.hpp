@@ -15,25 +15,31 @@ namespace greenbar {
 
     class BoldNode : public MarkdownNode {
     public:
-      BoldNode(const std::string& text) : MarkdownNode(MD_BOLD, text) { }
+      BoldNode(const NodeString& text) : MarkdownNode(MD_BOLD, text) { }
       ~BoldNode() { }
     };
 
     class ItalicsNode : public MarkdownNode {
     public:
-      ItalicsNode(const std::string& text) : MarkdownNode(MD_ITALICS, text) { }
+      ItalicsNode(const NodeString& text) : MarkdownNode(MD_ITALICS, text) { }
       ~ItalicsNode() { }
     };
 
+    class StrikethroughNode : public MarkdownNode {
+    public:
+      StrikethroughNode(const NodeString& text) : MarkdownNode(MD_STRIKETHROUGH, text) { }
+      ~StrikethroughNode() { }
+    };
+
     class FixedWidthNode : public MarkdownNode {
     public:
-      FixedWidthNode(const std::string& text) : MarkdownNode(MD_FIXED_WIDTH, text) { }
+      FixedWidthNode(const NodeString& text) : MarkdownNode(MD_FIXED_WIDTH, text) { }
       ~FixedWidthNode() { }
     };
 
     class FixedWidthBlockNode : public MarkdownNode {
     public:
-      FixedWidthBlockNode(const std::string& text): MarkdownNode(MD_FIXED_WIDTH_BLOCK, text) {
+      FixedWidthBlockNode(const NodeString& text): MarkdownNode(MD_FIXED_WIDTH_BLOCK, text) {
         terminates_line_ = true;
       }
       ~FixedWidthBlockNode() { }
@@ -46,10 +52,8 @@ namespace greenbar {
     };
 
     class HeaderNode : public MarkdownNode {
-    protected:
-      virtual ERL_NIF_TERM decorate_term(ErlNifEnv* env, ERL_NIF_TERM term);
     public:
-      HeaderNode(const std::string& text, int level) : MarkdownNode(MD_HEADER, text) {
+      HeaderNode(const NodeString& text, int level) : MarkdownNode(MD_HEADER, text) {
         put_attribute(ATTR_LEVEL, level);
       }
       ~HeaderNode() { }
@@ -59,10 +63,8 @@ namespace greenbar {
     };
 
     class LinkNode : public MarkdownNode {
-    protected:
-      virtual ERL_NIF_TERM decorate_term(ErlNifEnv* env, ERL_NIF_TERM term);
     public:
-      LinkNode(const std::string& title, const std::string& url) : MarkdownNode(MD_LINK, title) {
+      LinkNode(const NodeString& title, const NodeString& url) : MarkdownNode(MD_LINK, title) {
         put_attribute(ATTR_URL, url);
       }
       ~LinkNode() { }
@@ -70,7 +72,7 @@ namespace greenbar {
 
     class TextNode : public MarkdownNode {
     public:
-      TextNode(const std::string& text) : MarkdownNode(MD_TEXT, text) { }
+      TextNode(const NodeString& text) : MarkdownNode(MD_TEXT, text) { }
       ~TextNode() { }
       HeaderNode* to_header(int level) {
         return new HeaderNode(text_, level);
@@ -84,6 +86,10 @@ namespace greenbar {
         return new BoldNode(text_);
       }
 
+      StrikethroughNode* to_strikethrough() {
+        return new StrikethroughNode(text_);
+      }
+
       LinkNode* to_link() {
         return new LinkNode(text_, "");
       }
@@ -108,8 +114,6 @@ namespace greenbar {
     };
 
     class TableCellNode : public MarkdownNodeContainer {
-    protected:
-      virtual ERL_NIF_TERM decorate_term(ErlNifEnv* env, ERL_NIF_TERM term);
     public:
       TableCellNode() : MarkdownNodeContainer(MD_TABLE_CELL) { }
       ~TableCellNode() { }
@@ -127,6 +131,8 @@ namespace greenbar {
       TableNode() : MarkdownNodeContainer(MD_TABLE) { }
       ~TableNode() { }
       void mark_header();
+      // True when every cell holds at most a single text node
+      bool is_plain();
     };
 
     class ParagraphNode : public MarkdownNodeContainer {
@@ -5,11 +5,16 @@
 #include <string>
 #include <cstring>
 #include <vector>
-#include "erl_nif.h"
-#include "gb_common.hpp"
+
+#include "gb_memory.hpp"
 
 namespace greenbar {
   namespace node2 {
+    // Node text and containers allocate through greenbar::memory so parse
+    // memory is accounted for and served by the embedding allocator. Text
+    // may come from the small parse arena, see memory::begin_arena.
+    typedef std::basic_string<char, std::char_traits<char>, NodeAllocator<char> > NodeString;
+
     // Markdown node types
     enum NodeType {
       MD_NONE = 10,
@@ -21,6 +26,7 @@ namespace greenbar {
       MD_HEADER,
       MD_ITALICS,
       MD_BOLD,
+      MD_STRIKETHROUGH,
       MD_LINK,
       MD_LIST_ITEM,
       MD_ORDERED_LIST,
@@ -53,16 +59,16 @@ namespace greenbar {
     class AttributeValue {
     private:
       bool empty_;
-      std::string s_;
+      NodeString s_;
       int n_;
     public:
       AttributeValue() : empty_(true), s_(""), n_(0) {}
-      AttributeValue(const std::string& s) : empty_(false), s_(s), n_(0) {}
+      AttributeValue(const NodeString& s) : empty_(false), s_(s), n_(0) {}
       AttributeValue(int n) : empty_(false), s_(""), n_(n) {}
 
-      bool is_empty() { return empty_; }
-      const std::string& s() { return s_; }
-      int n() { return n_; }
+      bool is_empty() const { return empty_; }
+      const NodeString& s() const { return s_; }
+      int n() const { return n_; }
       bool operator==(const AttributeValue& other) {
         if (empty_ == other.empty_) {
           return true;
@@ -78,12 +84,11 @@ namespace greenbar {
     const AttributeValue ATTR_NOT_SET = AttributeValue();
 
     // Map of attributes
-    typedef std::map<NodeAttribute, AttributeValue> AttributeMap;
+    typedef std::map<NodeAttribute, AttributeValue, std::less<NodeAttribute>,
+                     NodeAllocator<std::pair<const NodeAttribute, AttributeValue> > > AttributeMap;
 
     // Helper functions
     std::string type_to_string(NodeType type);
-    ERL_NIF_TERM type_to_atom(NodeType type, gb_priv_s* priv_data);
-    ERL_NIF_TERM alignment_to_atom(NodeAlignment align, gb_priv_s* priv_data);
     inline bool is_markdown_list(NodeType type) { return type == MD_ORDERED_LIST || type == MD_UNORDERED_LIST; }
 
     // Base Markdown node type
@@ -93,14 +98,13 @@ namespace greenbar {
       MarkdownNode(MarkdownNode const &);
       MarkdownNode &operator=(MarkdownNode const &);
     protected:
-      std::string text_;
+      NodeString text_;
       NodeType type_;
       AttributeMap attributes_;
       bool terminates_line_;
-      virtual ERL_NIF_TERM decorate_term(ErlNifEnv* env, ERL_NIF_TERM term);
     public:
       MarkdownNode(NodeType type);
-      MarkdownNode(NodeType type, const std::string& text);
+      MarkdownNode(NodeType type, const NodeString& text);
       virtual ~MarkdownNode() {
         if (!attributes_.empty()) {
           attributes_.clear();
@@ -108,8 +112,17 @@ namespace greenbar {
       }
 
       NodeType get_type() { return type_; }
-      const std::string& get_text() { return text_; }
-      void set_text(std::string text) { text_ = text; }
+      const NodeString& get_text() { return text_; }
+      void set_text(const NodeString& text) { text_ = text; }
+
+      static void* operator new(size_t size) {
+        void* ptr = memory::allocate_node(size);
+        if (ptr == nullptr) {
+          throw std::bad_alloc();
+        }
+        return ptr;
+      }
+      static void operator delete(void* ptr) { memory::release(ptr); }
 
       virtual std::string to_string();
 
@@ -120,11 +133,12 @@ namespace greenbar {
       virtual bool line_terminator();
       bool terminates_line(bool flag);
 
-      virtual ERL_NIF_TERM to_erl_term(ErlNifEnv* env);
+      // Depth of the tree rooted at this node
+      virtual size_t depth() { return 1; }
     };
 
     // Vector of markdown nodes
-    typedef std::vector<MarkdownNode*> NodeVector;
+    typedef std::vector<MarkdownNode*, TrackedAllocator<MarkdownNode*> > NodeVector;
 
     // Base Markdown node for types with children
     class MarkdownNodeContainer : public MarkdownNode {
@@ -134,10 +148,9 @@ namespace greenbar {
       MarkdownNodeContainer &operator=(MarkdownNodeContainer const &);
     protected:
       NodeVector children_;
-      ERL_NIF_TERM children_to_term_list(ErlNifEnv* env);
-      virtual ERL_NIF_TERM decorate_term(ErlNifEnv* env, ERL_NIF_TERM term);
+      size_t depth_;
     public:
-      MarkdownNodeContainer(NodeType type) : MarkdownNode(type) { }
+      MarkdownNodeContainer(NodeType type) : MarkdownNode(type), depth_(1) { }
       virtual ~MarkdownNodeContainer();
       virtual std::string to_string();
       const NodeVector& get_children() { return children_; }
@@ -145,6 +158,7 @@ namespace greenbar {
       void drop_last(NodeType type);
       bool empty();
       bool line_terminator();
+      size_t depth() { return depth_; }
     };
   }
 }
@@ -0,0 +1,83 @@
+#ifndef GREENBAR_PARSE_LIMITS_H
+#define GREENBAR_PARSE_LIMITS_H
+
+#include <chrono>
+#include <cstddef>
+
+namespace greenbar {
+
+  // Limit which stopped a parse
+  enum LimitType {
+    LIMIT_NONE = 300,
+    LIMIT_INPUT_SIZE,
+    LIMIT_NODES,
+    LIMIT_NESTING,
+    LIMIT_TIMEOUT
+  };
+
+  // Per-call resource limits
+  // A value of 0 disables the limit
+  struct ParseLimits {
+    size_t max_input_size;
+    size_t max_nodes;
+    size_t max_nesting;
+    unsigned long timeout_ms;
+    ParseLimits() : max_input_size(0), max_nodes(0), max_nesting(0), timeout_ms(0) { }
+  };
+
+  // Tracks resource usage of a single parse, from analysis through term conversion.
+  // Once a limit is exceeded every check fails so callers can unwind quickly.
+  class LimitTracker {
+  private:
+    ParseLimits limits_;
+    std::chrono::steady_clock::time_point deadline_;
+    size_t nodes_;
+    unsigned int ticks_;
+    LimitType exceeded_;
+    bool fail(LimitType which) {
+      exceeded_ = which;
+      return false;
+    }
+  public:
+    LimitTracker() : nodes_(0), ticks_(0), exceeded_(LIMIT_NONE) { }
+
+    // Start tracking a new parse. The deadline is measured from here.
+    void reset(const ParseLimits& limits);
+
+    const ParseLimits& limits() { return limits_; }
+    size_t node_count() { return nodes_; }
+    bool exceeded() { return exceeded_ != LIMIT_NONE; }
+    LimitType which() { return exceeded_; }
+
+    bool check_input(size_t size);
+    bool check_depth(size_t depth);
+
+    // Account for a newly created node
+    bool add_node() {
+      if (exceeded()) {
+        return false;
+      }
+      nodes_++;
+      if (limits_.max_nodes > 0 && nodes_ > limits_.max_nodes) {
+        return fail(LIMIT_NODES);
+      }
+      return tick();
+    }
+
+    // Cheap progress check. The clock is only read every 64 calls.
+    bool tick() {
+      if (exceeded()) {
+        return false;
+      }
+      if (limits_.timeout_ms == 0 || (++ticks_ & 63) != 0) {
+        return true;
+      }
+      return check_deadline();
+    }
+
+    bool check_deadline();
+  };
+
+}
+
+#endif
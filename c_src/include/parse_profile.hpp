@@ -0,0 +1,65 @@
+#ifndef GREENBAR_PARSE_PROFILE_H
+#define GREENBAR_PARSE_PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "gb_stats.hpp"
+
+namespace greenbar {
+
+  // hoedown callbacks used by the analyzer. Values are array indices.
+  enum ProfileCallback {
+    CB_BLOCKCODE = 0,
+    CB_HEADER,
+    CB_PARAGRAPH,
+    CB_LIST,
+    CB_LISTITEM,
+    CB_TABLE,
+    CB_TABLE_HEADER,
+    CB_TABLE_ROW,
+    CB_TABLE_CELL,
+    CB_AUTOLINK,
+    CB_CODESPAN,
+    CB_EMPHASIS,
+    CB_DOUBLE_EMPHASIS,
+    CB_STRIKETHROUGH,
+    CB_LINK,
+    CB_LINEBREAK,
+    CB_NORMAL_TEXT,
+    CB_COUNT
+  };
+
+  // Where the time and memory of a single parse went
+  struct ParseProfile {
+    uint64_t render_us;
+    uint64_t convert_us;
+    uint64_t callbacks[CB_COUNT];
+    // Tables built directly instead of through the callbacks
+    uint64_t fast_tables;
+    // Result nodes by type, indexed from MD_NONE
+    uint64_t nodes[GB_NODE_TYPES];
+    // Deepest container pushed to the collector
+    size_t max_depth;
+    // Most nodes waiting in the collector at once
+    size_t max_collector;
+    uint64_t allocations;
+    uint64_t bytes_allocated;
+    // Most native memory held at once during the call
+    uint64_t peak_bytes;
+    ParseProfile();
+  };
+
+  // Name of a callback, as hoedown's renderer field
+  const char* callback_name(ProfileCallback callback);
+
+  namespace profile {
+    // Count allocations made on this thread into profile until called again with nullptr
+    void track_allocations(ParseProfile* profile);
+    // Called by greenbar::memory for every allocation
+    void count_allocation(size_t bytes);
+  }
+
+}
+
+#endif
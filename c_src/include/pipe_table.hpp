@@ -0,0 +1,61 @@
+#ifndef GREENBAR_PIPE_TABLE_H
+#define GREENBAR_PIPE_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gb_memory.hpp"
+#include "gb_simd.hpp"
+
+// Smallest body row count worth splitting a render for
+#define GB_FAST_TABLE_MIN_ROWS 32
+
+namespace greenbar {
+
+  // Byte range within the input
+  struct TextSpan {
+    size_t begin;
+    size_t end;
+  };
+
+  // A pipe table whose cells are all plain, non-empty text
+  struct PipeTable {
+    size_t start;
+    size_t end;
+    size_t columns;
+    // hoedown_table_flags for each column
+    std::vector<unsigned int, TrackedAllocator<unsigned int> > column_flags;
+    // Header cells followed by body cells, columns cells per row
+    std::vector<TextSpan, TrackedAllocator<TextSpan> > cells;
+  };
+
+  // Finds pipe tables which hoedown would parse into exactly the cells found
+  // here. Anything unusual is skipped and left for hoedown to render.
+  class PipeTableScanner {
+  private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_;
+    size_t min_rows_;
+    bool enabled_;
+    bool prev_blank_;
+    bool fenced_code_;
+    uint8_t fence_char_;
+    size_t fence_width_;
+    simd::ByteSet inline_chars_;
+    size_t line_end(size_t begin);
+    bool update_fence(size_t begin, size_t end);
+    bool scan_separator(size_t begin, size_t end, PipeTable* table);
+    bool split_row(size_t begin, size_t end, PipeTable* table);
+    bool scan_table(size_t begin, PipeTable* table);
+
+  public:
+    PipeTableScanner(const uint8_t* data, size_t size, unsigned int extensions, size_t min_rows);
+    // Find the next table. Returns false when there are none left.
+    bool next(PipeTable* table);
+  };
+
+}
+
+#endif
@@ -0,0 +1,302 @@
+#include <cstring>
+#include <vector>
+
+#include "gb_etf.hpp"
+#include "gb_json.hpp"
+#include "gb_stats.hpp"
+#include "md_node.hpp"
+
+// External term format tags
+#define ETF_VERSION 131
+#define ETF_SMALL_INTEGER 97
+#define ETF_INTEGER 98
+#define ETF_SMALL_TUPLE 104
+#define ETF_LARGE_TUPLE 105
+#define ETF_NIL 106
+#define ETF_LIST 108
+#define ETF_BINARY 109
+#define ETF_MAP 116
+#define ETF_SMALL_ATOM_UTF8 119
+
+using namespace greenbar::node2;
+
+namespace greenbar {
+  namespace etf {
+
+    // Lengths and arities are big endian
+    static void put_u32(hoedown_buffer* out, uint32_t value) {
+      uint8_t bytes[4] = {(uint8_t) (value >> 24), (uint8_t) (value >> 16), (uint8_t) (value >> 8), (uint8_t) value};
+      hoedown_buffer_put(out, bytes, sizeof(bytes));
+    }
+
+    void put_version(hoedown_buffer* out) {
+      hoedown_buffer_putc(out, ETF_VERSION);
+    }
+
+    // Names are short ASCII literals
+    void put_atom(hoedown_buffer* out, const char* name) {
+      size_t size = strlen(name);
+      hoedown_buffer_putc(out, ETF_SMALL_ATOM_UTF8);
+      hoedown_buffer_putc(out, (uint8_t) size);
+      hoedown_buffer_put(out, (const uint8_t*) name, size);
+    }
+
+    void put_tuple(hoedown_buffer* out, size_t arity) {
+      if (arity < 256) {
+        hoedown_buffer_putc(out, ETF_SMALL_TUPLE);
+        hoedown_buffer_putc(out, (uint8_t) arity);
+      } else {
+        hoedown_buffer_putc(out, ETF_LARGE_TUPLE);
+        put_u32(out, arity);
+      }
+    }
+
+    void put_binary(hoedown_buffer* out, const uint8_t* data, size_t size) {
+      hoedown_buffer_putc(out, ETF_BINARY);
+      put_u32(out, size);
+      hoedown_buffer_put(out, data, size);
+    }
+
+    void put_integer(hoedown_buffer* out, int32_t value) {
+      if (value >= 0 && value < 256) {
+        hoedown_buffer_putc(out, ETF_SMALL_INTEGER);
+        hoedown_buffer_putc(out, (uint8_t) value);
+      } else {
+        hoedown_buffer_putc(out, ETF_INTEGER);
+        put_u32(out, (uint32_t) value);
+      }
+    }
+
+    void put_limit_error(hoedown_buffer* out, LimitType which) {
+      put_tuple(out, 3);
+      put_atom(out, "error");
+      put_atom(out, "limit_exceeded");
+      switch(which) {
+      case LIMIT_INPUT_SIZE:
+        put_atom(out, "input_size");
+        break;
+      case LIMIT_NODES:
+        put_atom(out, "nodes");
+        break;
+      case LIMIT_NESTING:
+        put_atom(out, "nesting");
+        break;
+      default:
+        put_atom(out, "timeout");
+      }
+    }
+
+    static void put_map(hoedown_buffer* out, size_t arity) {
+      hoedown_buffer_putc(out, ETF_MAP);
+      put_u32(out, arity);
+    }
+
+    // A non-empty list header, followed by the elements and put_nil
+    static void put_list(hoedown_buffer* out, size_t length) {
+      hoedown_buffer_putc(out, ETF_LIST);
+      put_u32(out, length);
+    }
+
+    static void put_nil(hoedown_buffer* out) {
+      hoedown_buffer_putc(out, ETF_NIL);
+    }
+
+  }
+
+  // State shared by a single tree to ETF conversion
+  struct EtfContext {
+    hoedown_buffer* out;
+    LimitTracker* limits;
+    const ParserConfig& config;
+    ParseProfile* profile;
+  };
+
+  static void put_string(hoedown_buffer* out, const NodeString& value) {
+    etf::put_binary(out, (const uint8_t*) value.data(), value.size());
+  }
+
+  static bool put_node(EtfContext& ctx, MarkdownNode* node);
+
+  // Children are stored last to first
+  static bool put_children(EtfContext& ctx, MarkdownNodeContainer* node) {
+    etf::put_atom(ctx.out, "children");
+    auto& children = node->get_children();
+    if (!children.empty()) {
+      etf::put_list(ctx.out, children.size());
+    }
+    for (auto iter = children.rbegin(); iter != children.rend(); ++iter) {
+      if (!ctx.limits->tick() || !put_node(ctx, *iter)) {
+        return false;
+      }
+    }
+    etf::put_nil(ctx.out);
+    return true;
+  }
+
+  static void put_cell_text(EtfContext& ctx, MarkdownNode* cell) {
+    auto& content = static_cast<MarkdownNodeContainer*>(cell)->get_children();
+    if (content.empty()) {
+      put_string(ctx.out, NodeString());
+      return;
+    }
+    put_string(ctx.out, content[0]->get_text());
+  }
+
+  static void put_row(EtfContext& ctx, MarkdownNodeContainer* row) {
+    auto& cells = row->get_children();
+    etf::put_tuple(ctx.out, cells.size());
+    for (auto iter = cells.rbegin(); iter != cells.rend(); ++iter) {
+      put_cell_text(ctx, *iter);
+    }
+  }
+
+  static void put_rows(EtfContext& ctx, MarkdownNodeContainer* const* rows, size_t count) {
+    if (count > 0) {
+      etf::put_list(ctx.out, count);
+    }
+    for (size_t i = 0; i < count; i++) {
+      put_row(ctx, rows[i]);
+    }
+    etf::put_nil(ctx.out);
+  }
+
+  // Same layout as put_columnar_table in the term builder. Map keys can't
+  // repeat, so the cells of every header row are gathered first.
+  static bool put_columnar_table(EtfContext& ctx, TableNode* table) {
+    auto& children = table->get_children();
+    std::vector<MarkdownNode*> header;
+    std::vector<MarkdownNodeContainer*> rows;
+    rows.reserve(children.size());
+    for (auto iter = children.rbegin(); iter != children.rend(); ++iter) {
+      if (!ctx.limits->tick()) {
+        return false;
+      }
+      auto row = static_cast<MarkdownNodeContainer*>(*iter);
+      if (row->get_type() == MD_TABLE_HEADER) {
+        auto& cells = row->get_children();
+        header.insert(header.begin(), cells.rbegin(), cells.rend());
+      } else {
+        rows.push_back(row);
+      }
+    }
+    etf::put_atom(ctx.out, "header");
+    if (!header.empty()) {
+      etf::put_list(ctx.out, header.size());
+    }
+    for (auto cell : header) {
+      put_cell_text(ctx, cell);
+    }
+    etf::put_nil(ctx.out);
+    etf::put_atom(ctx.out, "alignments");
+    if (!header.empty()) {
+      etf::put_list(ctx.out, header.size());
+    }
+    for (auto cell : header) {
+      int align = cell->has_attribute(ATTR_ALIGNMENT) ? cell->get_attribute(ATTR_ALIGNMENT).n() : ALIGN_NONE;
+      etf::put_atom(ctx.out, align == ALIGN_NONE ? "none" : node_alignment_name(align));
+    }
+    etf::put_nil(ctx.out);
+    size_t batch = ctx.config.table_batch_size;
+    if (batch == 0) {
+      etf::put_atom(ctx.out, "rows");
+      put_rows(ctx, rows.data(), rows.size());
+      return true;
+    }
+    etf::put_atom(ctx.out, "row_batches");
+    size_t batch_count = (rows.size() + batch - 1) / batch;
+    if (batch_count > 0) {
+      etf::put_list(ctx.out, batch_count);
+    }
+    for (size_t start = 0; start < rows.size(); start += batch) {
+      put_rows(ctx, rows.data() + start, rows.size() - start < batch ? rows.size() - start : batch);
+    }
+    etf::put_nil(ctx.out);
+    return true;
+  }
+
+  static bool put_node(EtfContext& ctx, MarkdownNode* node) {
+    stats::add_node(node->get_type());
+    if (ctx.profile != nullptr) {
+      ctx.profile->nodes[node->get_type() - MD_NONE]++;
+    }
+    hoedown_buffer* out = ctx.out;
+    auto& text = node->get_text();
+    switch(node->get_type()) {
+    case MD_HEADER:
+      etf::put_map(out, text.empty() ? 2 : 3);
+      etf::put_atom(out, "name");
+      etf::put_atom(out, "header");
+      if (!text.empty()) {
+        etf::put_atom(out, "text");
+        put_string(out, text);
+      }
+      etf::put_atom(out, "level");
+      etf::put_integer(out, node->get_attribute(ATTR_LEVEL).n());
+      return true;
+    case MD_LINK:
+      etf::put_map(out, 3);
+      etf::put_atom(out, "name");
+      etf::put_atom(out, "link");
+      etf::put_atom(out, "url");
+      put_string(out, node->get_attribute(ATTR_URL).s());
+      etf::put_atom(out, "text");
+      put_string(out, text);
+      return true;
+    case MD_TABLE_CELL: {
+      int align = node->has_attribute(ATTR_ALIGNMENT) ? node->get_attribute(ATTR_ALIGNMENT).n() : ALIGN_NONE;
+      etf::put_map(out, align == ALIGN_NONE ? 2 : 3);
+      etf::put_atom(out, "name");
+      etf::put_atom(out, "table_cell");
+      if (align != ALIGN_NONE) {
+        etf::put_atom(out, "alignment");
+        etf::put_atom(out, node_alignment_name(align));
+      }
+      return put_children(ctx, static_cast<MarkdownNodeContainer*>(node));
+    }
+    case MD_TABLE: {
+      auto table = static_cast<TableNode*>(node);
+      bool columnar = ctx.config.tables == TABLES_COLUMNAR && table->is_plain();
+      etf::put_map(out, columnar ? 4 : 2);
+      etf::put_atom(out, "name");
+      etf::put_atom(out, "table");
+      return columnar ? put_columnar_table(ctx, table) : put_children(ctx, table);
+    }
+    default:
+      break;
+    }
+    // Header rows share their type with the childless header marker
+    auto container = dynamic_cast<MarkdownNodeContainer*>(node);
+    etf::put_map(out, container == nullptr && text.empty() ? 1 : 2);
+    etf::put_atom(out, "name");
+    etf::put_atom(out, node_type_name(node->get_type()));
+    if (container != nullptr) {
+      return put_children(ctx, container);
+    }
+    if (!text.empty()) {
+      etf::put_atom(out, "text");
+      put_string(out, text);
+    }
+    return true;
+  }
+
+  bool collector_to_etf(hoedown_buffer* out, NodeVector* collector, LimitTracker* limits,
+                        const ParserConfig& config, ParseProfile* profile) {
+    EtfContext ctx = {out, limits, config, profile};
+    size_t count = collector->size();
+    // Don't add double EOLs to end of template
+    if (count > 1 && collector->at(count - 1)->get_type() == MD_EOL && collector->at(count - 2)->get_type() == MD_EOL) {
+      count--;
+    }
+    if (count > 0) {
+      etf::put_list(out, count);
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (!limits->tick() || !put_node(ctx, collector->at(i))) {
+        return false;
+      }
+    }
+    etf::put_nil(out);
+    return true;
+  }
+
+}
@@ -0,0 +1,353 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "gb_json.hpp"
+#include "gb_simd.hpp"
+#include "gb_stats.hpp"
+#include "md_node.hpp"
+
+using namespace greenbar::node2;
+
+namespace greenbar {
+
+  const char* node_type_name(NodeType type) {
+    switch(type) {
+    case MD_EOL:
+      return "newline";
+    case MD_PARAGRAPH:
+      return "paragraph";
+    case MD_FIXED_WIDTH:
+      return "fixed_width";
+    case MD_FIXED_WIDTH_BLOCK:
+      return "fixed_width_block";
+    case MD_HEADER:
+      return "header";
+    case MD_ITALICS:
+      return "italics";
+    case MD_BOLD:
+      return "bold";
+    case MD_STRIKETHROUGH:
+      return "strikethrough";
+    case MD_LINK:
+      return "link";
+    case MD_LIST_ITEM:
+      return "list_item";
+    case MD_ORDERED_LIST:
+      return "ordered_list";
+    case MD_UNORDERED_LIST:
+      return "unordered_list";
+    case MD_TABLE_CELL:
+      return "table_cell";
+    case MD_TABLE_ROW:
+      return "table_row";
+    case MD_TABLE_HEADER:
+      return "table_header";
+    case MD_TABLE:
+      return "table";
+    default:
+      return "text";
+    }
+  }
+
+  const char* node_alignment_name(int align) {
+    switch(align) {
+    case ALIGN_RIGHT:
+      return "right";
+    case ALIGN_CENTER:
+      return "center";
+    default:
+      return "left";
+    }
+  }
+
+  // State shared by a single tree to JSON conversion
+  struct JsonContext {
+    hoedown_buffer* out;
+    LimitTracker* limits;
+    const ParserConfig& config;
+    ParseProfile* profile;
+  };
+
+  static inline void put(hoedown_buffer* out, const char* text) {
+    hoedown_buffer_put(out, (const uint8_t*) text, strlen(text));
+  }
+
+  // Length of the well-formed UTF-8 sequence at the start of data, or 0.
+  // Overlong forms, surrogates and code points past U+10FFFF are rejected.
+  static size_t utf8_sequence(const uint8_t* data, size_t size) {
+    uint8_t c = data[0];
+    size_t length;
+    uint8_t low = 0x80, high = 0xbf;
+    if (c >= 0xc2 && c <= 0xdf) {
+      length = 2;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      length = 3;
+      low = c == 0xe0 ? 0xa0 : 0x80;
+      high = c == 0xed ? 0x9f : 0xbf;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      length = 4;
+      low = c == 0xf0 ? 0x90 : 0x80;
+      high = c == 0xf4 ? 0x8f : 0xbf;
+    } else {
+      return 0;
+    }
+    if (size < length || data[1] < low || data[1] > high) {
+      return 0;
+    }
+    for (size_t i = 2; i < length; i++) {
+      if ((data[i] & 0xc0) != 0x80) {
+        return 0;
+      }
+    }
+    return length;
+  }
+
+  // Runs without escapes are copied in one go. Bytes that aren't part of
+  // well-formed UTF-8 each become U+FFFD, so the output is always valid.
+  static void put_string(hoedown_buffer* out, const uint8_t* data, size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    hoedown_buffer_putc(out, '"');
+    size_t i = 0;
+    while (i < size) {
+      size_t run = simd::find_json_escape(data + i, size - i);
+      hoedown_buffer_put(out, data + i, run);
+      i += run;
+      if (i == size) {
+        break;
+      }
+      if (data[i] >= 0x80) {
+        size_t length = utf8_sequence(data + i, size - i);
+        if (length == 0) {
+          put(out, "\\ufffd");
+          i++;
+        } else {
+          hoedown_buffer_put(out, data + i, length);
+          i += length;
+        }
+        continue;
+      }
+      uint8_t c = data[i++];
+      switch(c) {
+      case '"':
+        put(out, "\\\"");
+        break;
+      case '\\':
+        put(out, "\\\\");
+        break;
+      case '\n':
+        put(out, "\\n");
+        break;
+      case '\r':
+        put(out, "\\r");
+        break;
+      case '\t':
+        put(out, "\\t");
+        break;
+      default:
+        put(out, "\\u00");
+        hoedown_buffer_putc(out, hex[c >> 4]);
+        hoedown_buffer_putc(out, hex[c & 0xf]);
+      }
+    }
+    hoedown_buffer_putc(out, '"');
+  }
+
+  void put_json_string(hoedown_buffer* out, const uint8_t* data, size_t size) {
+    put_string(out, data, size);
+  }
+
+  static void put_string(hoedown_buffer* out, const NodeString& value) {
+    put_string(out, (const uint8_t*) value.data(), value.size());
+  }
+
+  static void put_key(hoedown_buffer* out, const char* key) {
+    hoedown_buffer_putc(out, ',');
+    hoedown_buffer_putc(out, '"');
+    put(out, key);
+    put(out, "\":");
+  }
+
+  static bool put_node(JsonContext& ctx, MarkdownNode* node);
+
+  // Children are stored last to first
+  static bool put_children(JsonContext& ctx, MarkdownNodeContainer* node) {
+    put_key(ctx.out, "children");
+    hoedown_buffer_putc(ctx.out, '[');
+    auto& children = node->get_children();
+    for (auto iter = children.rbegin(); iter != children.rend(); ++iter) {
+      if (!ctx.limits->tick()) {
+        return false;
+      }
+      if (iter != children.rbegin()) {
+        hoedown_buffer_putc(ctx.out, ',');
+      }
+      if (!put_node(ctx, *iter)) {
+        return false;
+      }
+    }
+    hoedown_buffer_putc(ctx.out, ']');
+    return true;
+  }
+
+  static void put_text(JsonContext& ctx, MarkdownNode* node) {
+    auto& text = node->get_text();
+    if (text.size() > 0) {
+      put_key(ctx.out, "text");
+      put_string(ctx.out, text);
+    }
+  }
+
+  static void put_cell_text(JsonContext& ctx, MarkdownNode* cell) {
+    auto& content = static_cast<MarkdownNodeContainer*>(cell)->get_children();
+    if (content.empty()) {
+      put(ctx.out, "\"\"");
+      return;
+    }
+    put_string(ctx.out, content[0]->get_text());
+  }
+
+  static void put_row(JsonContext& ctx, MarkdownNodeContainer* row) {
+    auto& cells = row->get_children();
+    hoedown_buffer_putc(ctx.out, '[');
+    for (auto iter = cells.rbegin(); iter != cells.rend(); ++iter) {
+      if (iter != cells.rbegin()) {
+        hoedown_buffer_putc(ctx.out, ',');
+      }
+      put_cell_text(ctx, *iter);
+    }
+    hoedown_buffer_putc(ctx.out, ']');
+  }
+
+  // Same layout as put_columnar_table in the term builder, rows as arrays
+  static bool put_columnar_table(JsonContext& ctx, TableNode* table) {
+    auto& children = table->get_children();
+    std::vector<MarkdownNodeContainer*> rows;
+    rows.reserve(children.size());
+    for (auto iter = children.rbegin(); iter != children.rend(); ++iter) {
+      if (!ctx.limits->tick()) {
+        return false;
+      }
+      auto row = static_cast<MarkdownNodeContainer*>(*iter);
+      if (row->get_type() != MD_TABLE_HEADER) {
+        rows.push_back(row);
+        continue;
+      }
+      put_key(ctx.out, "header");
+      put_row(ctx, row);
+      put_key(ctx.out, "alignments");
+      hoedown_buffer_putc(ctx.out, '[');
+      auto& cells = row->get_children();
+      for (auto cell = cells.rbegin(); cell != cells.rend(); ++cell) {
+        if (cell != cells.rbegin()) {
+          hoedown_buffer_putc(ctx.out, ',');
+        }
+        int align = (*cell)->has_attribute(ATTR_ALIGNMENT) ? (*cell)->get_attribute(ATTR_ALIGNMENT).n() : ALIGN_NONE;
+        hoedown_buffer_putc(ctx.out, '"');
+        put(ctx.out, align == ALIGN_NONE ? "none" : node_alignment_name(align));
+        hoedown_buffer_putc(ctx.out, '"');
+      }
+      hoedown_buffer_putc(ctx.out, ']');
+    }
+    size_t batch = ctx.config.table_batch_size;
+    put_key(ctx.out, batch == 0 ? "rows" : "row_batches");
+    hoedown_buffer_putc(ctx.out, '[');
+    for (size_t i = 0; i < rows.size(); i++) {
+      if (batch > 0 && i % batch == 0) {
+        put(ctx.out, i > 0 ? "],[" : "[");
+      } else if (i > 0) {
+        hoedown_buffer_putc(ctx.out, ',');
+      }
+      put_row(ctx, rows[i]);
+    }
+    if (batch > 0 && !rows.empty()) {
+      hoedown_buffer_putc(ctx.out, ']');
+    }
+    hoedown_buffer_putc(ctx.out, ']');
+    return true;
+  }
+
+  static bool put_node(JsonContext& ctx, MarkdownNode* node) {
+    stats::add_node(node->get_type());
+    if (ctx.profile != nullptr) {
+      ctx.profile->nodes[node->get_type() - MD_NONE]++;
+    }
+    bool ok = true;
+    put(ctx.out, "{\"name\":\"");
+    put(ctx.out, node_type_name(node->get_type()));
+    hoedown_buffer_putc(ctx.out, '"');
+    switch(node->get_type()) {
+    case MD_HEADER: {
+      char level[16];
+      put_text(ctx, node);
+      put_key(ctx.out, "level");
+      snprintf(level, sizeof(level), "%d", node->get_attribute(ATTR_LEVEL).n());
+      put(ctx.out, level);
+      break;
+    }
+    case MD_LINK:
+      put_key(ctx.out, "url");
+      put_string(ctx.out, node->get_attribute(ATTR_URL).s());
+      put_key(ctx.out, "text");
+      put_string(ctx.out, node->get_text());
+      break;
+    case MD_TABLE_CELL: {
+      ok = put_children(ctx, static_cast<MarkdownNodeContainer*>(node));
+      int align = node->has_attribute(ATTR_ALIGNMENT) ? node->get_attribute(ATTR_ALIGNMENT).n() : ALIGN_NONE;
+      if (ok && align != ALIGN_NONE) {
+        put_key(ctx.out, "alignment");
+        hoedown_buffer_putc(ctx.out, '"');
+        put(ctx.out, node_alignment_name(align));
+        hoedown_buffer_putc(ctx.out, '"');
+      }
+      break;
+    }
+    case MD_TABLE: {
+      auto table = static_cast<TableNode*>(node);
+      if (ctx.config.tables == TABLES_COLUMNAR && table->is_plain()) {
+        ok = put_columnar_table(ctx, table);
+      } else {
+        ok = put_children(ctx, table);
+      }
+      break;
+    }
+    default: {
+      // Header rows share their type with the childless header marker
+      auto container = dynamic_cast<MarkdownNodeContainer*>(node);
+      if (container != nullptr) {
+        ok = put_children(ctx, container);
+      } else {
+        put_text(ctx, node);
+      }
+    }
+    }
+    hoedown_buffer_putc(ctx.out, '}');
+    return ok;
+  }
+
+  bool collector_to_json(hoedown_buffer* out, NodeVector* collector, LimitTracker* limits,
+                         const ParserConfig& config, ParseProfile* profile) {
+    JsonContext ctx = {out, limits, config, profile};
+    hoedown_buffer_putc(out, '[');
+    size_t count = collector->size();
+    for (size_t i = 0; i < count; i++) {
+      auto node = collector->at(i);
+      // Don't add double EOLs to end of template
+      if (i > 0 && i == count - 1 && node->get_type() == MD_EOL && collector->at(i - 1)->get_type() == MD_EOL) {
+        continue;
+      }
+      if (!limits->tick()) {
+        return false;
+      }
+      if (i > 0) {
+        hoedown_buffer_putc(out, ',');
+      }
+      if (!put_node(ctx, node)) {
+        return false;
+      }
+    }
+    hoedown_buffer_putc(out, ']');
+    return true;
+  }
+
+}
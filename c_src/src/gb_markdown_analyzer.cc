@@ -2,15 +2,16 @@
 #include <iostream>
 #include <cstring>
 #include <cstdlib>
+#include <new>
 
-#include "erl_nif.h"
 #include "document.h"
 #include "buffer.h"
 #include "md_node.hpp"
+#include "markdown_analyzer.hpp"
+#include "parse_limits.hpp"
+#include "pipe_table.hpp"
 #include "debug.hpp"
 
-typedef hoedown_renderer markdown_analyzer;
-
 static void gb_markdown_blockcode(hoedown_buffer *ob, const hoedown_buffer *text, const hoedown_buffer *lang, const hoedown_renderer_data *data);
 static void gb_markdown_header(hoedown_buffer *ob, const hoedown_buffer *content, int level, const hoedown_renderer_data *data);
 static void gb_markdown_list(hoedown_buffer *ob, const hoedown_buffer *content, hoedown_list_flags flags, const hoedown_renderer_data *data);
@@ -25,24 +26,33 @@ static int gb_markdown_autolink(hoedown_buffer *ob, const hoedown_buffer *link,
 static int gb_markdown_codespan(hoedown_buffer *ob, const hoedown_buffer *text, const hoedown_renderer_data *data);
 static int gb_markdown_emphasis(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data);
 static int gb_markdown_double_emphasis(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data);
+static int gb_markdown_strikethrough(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data);
 static int gb_markdown_linebreak(hoedown_buffer *ob, const hoedown_renderer_data *data);
 static int gb_markdown_link(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_buffer *link, const hoedown_buffer *title,
                      const hoedown_renderer_data *data);
 static int gb_markdown_linebreak(hoedown_buffer *ob, const hoedown_renderer_data *data);
 static void gb_markdown_normal_text(hoedown_buffer *ob, const hoedown_buffer *text, const hoedown_renderer_data *data);
 
-#define GB_HOEDOWN_EXTENSIONS (hoedown_extensions) (HOEDOWN_EXT_DISABLE_INDENTED_CODE | HOEDOWN_EXT_SPACE_HEADERS | \
-                                                    HOEDOWN_EXT_MATH_EXPLICIT | HOEDOWN_EXT_NO_INTRA_EMPHASIS | \
-                                                    HOEDOWN_EXT_TABLES | HOEDOWN_EXT_FENCED_CODE)
-#define GB_MAX_NESTING 16
-
 using namespace greenbar::node2;
 
 namespace greenbar {
 
+  // Per-analyzer state reachable from callbacks through hoedown's opaque pointer
+  struct AnalyzerState {
+    NodeVector collector;
+    LimitTracker limits;
+    // Set only while a profiled render is running
+    ParseProfile* profile;
+    // Set only while a streamed render is running
+    BlockSink sink;
+    void* sink_ctx;
+    const hoedown_buffer* top_ob;
+    AnalyzerState() : profile(nullptr), sink(nullptr), sink_ctx(nullptr), top_ob(nullptr) { }
+  };
+
   markdown_analyzer* new_markdown_analyzer() {
     // Create renderer
-    auto analyzer = (markdown_analyzer *) malloc(sizeof(markdown_analyzer));
+    auto analyzer = (markdown_analyzer *) memory::allocate(sizeof(markdown_analyzer));
     if (!analyzer) {
       return nullptr;
     }
@@ -59,6 +69,7 @@ namespace greenbar {
     analyzer->emphasis = gb_markdown_emphasis;
     analyzer->double_emphasis = gb_markdown_double_emphasis;
     analyzer->triple_emphasis = gb_markdown_double_emphasis;
+    analyzer->strikethrough = gb_markdown_strikethrough;
     analyzer->autolink = gb_markdown_autolink;
     analyzer->link = gb_markdown_link;
     analyzer->list = gb_markdown_list;
@@ -69,7 +80,12 @@ namespace greenbar {
     analyzer->table_cell = gb_markdown_table_cell;
     analyzer->normal_text = gb_markdown_normal_text;
     analyzer->linebreak = gb_markdown_linebreak;
-    analyzer->opaque = (void *) new NodeVector();
+    void* state = memory::allocate(sizeof(AnalyzerState));
+    if (state == nullptr) {
+      memory::release(analyzer);
+      return nullptr;
+    }
+    analyzer->opaque = (void *) new (state) AnalyzerState();
     return analyzer;
   }
 
@@ -77,63 +93,175 @@ namespace greenbar {
     return hoedown_document_new(renderer, (hoedown_extensions) GB_HOEDOWN_EXTENSIONS, GB_MAX_NESTING);
   }
 
+  hoedown_document* new_hoedown_document(markdown_analyzer* renderer, size_t max_nesting) {
+    return new_hoedown_document(renderer, GB_HOEDOWN_EXTENSIONS, max_nesting);
+  }
+
+  hoedown_document* new_hoedown_document(markdown_analyzer* renderer, unsigned int extensions, size_t max_nesting) {
+    // hoedown counts block and span work buffers separately so it needs
+    // roughly two levels per tree level. Never go below the default or
+    // above the ceiling.
+    size_t nesting = GB_MAX_NESTING;
+    if (max_nesting > nesting / 2) {
+      nesting = max_nesting < GB_HOEDOWN_NESTING_CEILING / 2 ? max_nesting * 2 : GB_HOEDOWN_NESTING_CEILING;
+    }
+    return hoedown_document_new(renderer, (hoedown_extensions) extensions, nesting);
+  }
+
+  void clear_collector(markdown_analyzer* analyzer) {
+    auto collector = get_collector(analyzer);
+    while (!collector->empty()) {
+      auto node = collector->back();
+      collector->pop_back();
+      delete node;
+    }
+  }
+
   void free_markdown_analyzer(markdown_analyzer* analyzer) {
     if (analyzer->opaque != nullptr) {
-      auto collector = (NodeVector*) analyzer->opaque;
-      while (!collector->empty()) {
-        auto node = collector->back();
-        collector->pop_back();
-        delete node;
-      }
-      delete collector;
+      clear_collector(analyzer);
+      auto state = (AnalyzerState*) analyzer->opaque;
+      state->~AnalyzerState();
+      memory::release(state);
     }
-    free(analyzer);
+    memory::release(analyzer);
   }
 
   NodeVector* get_collector(markdown_analyzer* analyzer) {
-    return (NodeVector*) analyzer->opaque;
+    return &((AnalyzerState*) analyzer->opaque)->collector;
+  }
+
+  LimitTracker* get_limits(markdown_analyzer* analyzer) {
+    return &((AnalyzerState*) analyzer->opaque)->limits;
+  }
+
+  void set_profile(markdown_analyzer* analyzer, ParseProfile* profile) {
+    auto state = (AnalyzerState*) analyzer->opaque;
+    // Catch the collector's final size before detaching
+    if (state->profile != nullptr && state->collector.size() > state->profile->max_collector) {
+      state->profile->max_collector = state->collector.size();
+    }
+    state->profile = profile;
+  }
+
+  void set_block_sink(markdown_analyzer* analyzer, const hoedown_buffer* ob, BlockSink sink, void* ctx) {
+    auto state = (AnalyzerState*) analyzer->opaque;
+    state->sink = sink;
+    state->sink_ctx = ctx;
+    state->top_ob = sink != nullptr ? ob : nullptr;
   }
 
 }
 
-static std::string hoedown_buffer_to_string(const hoedown_buffer* buf) {
+static NodeString hoedown_buffer_to_string(const hoedown_buffer* buf) {
   if (buf == nullptr) {
-    return std::string("");
+    return NodeString();
   }
-  return std::string((char*) buf->data, buf->size);
+  return NodeString((char*) buf->data, buf->size);
 }
 
-static std::string hoedown_buffer_to_string(const hoedown_buffer* buf, unsigned int begin, unsigned int end) {
+static NodeString hoedown_buffer_to_string(const hoedown_buffer* buf, unsigned int begin, unsigned int end) {
   if (buf == nullptr) {
-    return std::string("");
+    return NodeString();
   }
-  return std::string((char*) &buf->data[begin], end);
+  return NodeString((char*) &buf->data[begin], end);
 }
 
 static NodeVector* get_collector(const hoedown_renderer_data *data) {
-  return (NodeVector*) data->opaque;
+  return &((greenbar::AnalyzerState*) data->opaque)->collector;
+}
+
+static greenbar::LimitTracker* get_limits(const hoedown_renderer_data *data) {
+  return &((greenbar::AnalyzerState*) data->opaque)->limits;
+}
+
+// hoedown can't be stopped mid-render so once a limit trips
+// the remaining callbacks do nothing
+static bool halted(const hoedown_renderer_data *data) {
+  return !get_limits(data)->tick();
+}
+
+// Count a node created by a callback. Nodes are still collected
+// after the limit trips so they get freed with the analyzer.
+static void count_node(const hoedown_renderer_data *data) {
+  get_limits(data)->add_node();
+}
+
+// Records a callback when the render is being profiled. Every push to the
+// collector is followed by another callback or the end of the render, so
+// sampling the collector here catches its peak.
+static void note_callback(const hoedown_renderer_data *data, greenbar::ProfileCallback callback) {
+  auto state = (greenbar::AnalyzerState*) data->opaque;
+  if (state->profile != nullptr) {
+    state->profile->callbacks[callback]++;
+    if (state->collector.size() > state->profile->max_collector) {
+      state->profile->max_collector = state->collector.size();
+    }
+  }
+}
+
+static void push_container(NodeVector* collector, MarkdownNodeContainer* node, const hoedown_renderer_data *data) {
+  get_limits(data)->check_depth(node->depth());
+  auto profile = ((greenbar::AnalyzerState*) data->opaque)->profile;
+  if (profile != nullptr && node->depth() > profile->max_depth) {
+    profile->max_depth = node->depth();
+  }
+  collector->push_back(node);
+}
+
+// Called after a paragraph is added. Once it is a top-level one, nodes up
+// to the paragraph before the last one are final: the paragraph and table
+// cell callbacks stop at the last paragraph and list items reaching past it
+// stop at the one before, so nothing later can absorb them.
+static void block_done(const hoedown_buffer *ob, const hoedown_renderer_data *data) {
+  auto state = (greenbar::AnalyzerState*) data->opaque;
+  if (state->sink == nullptr || ob != state->top_ob || state->limits.exceeded()) {
+    return;
+  }
+  auto& collector = state->collector;
+  size_t paragraphs = 0;
+  size_t sealed = collector.size();
+  while (sealed > 0) {
+    if (collector[sealed - 1]->get_type() == MD_PARAGRAPH && ++paragraphs == 2) {
+      break;
+    }
+    sealed--;
+  }
+  if (sealed == 0) {
+    return;
+  }
+  for (size_t i = 0; i < sealed; i++) {
+    state->sink(state->sink_ctx, collector[i]);
+  }
+  collector.erase(collector.begin(), collector.begin() + sealed);
 }
 
 static void gb_markdown_blockcode(hoedown_buffer *ob, const hoedown_buffer *text, const hoedown_buffer *lang,
                                   const hoedown_renderer_data *data) {
-  if (text == nullptr || text->size == 0 || (text->size == 1 && text->data[0] == '\n')) {
+  note_callback(data, greenbar::CB_BLOCKCODE);
+  if (text == nullptr || text->size == 0 || (text->size == 1 && text->data[0] == '\n') || halted(data)) {
     return;
   }
   auto collector = get_collector(data);
-  std::string block_text = "";
+  NodeString block_text;
   if (text->size > 1) {
     uint8_t last_char = text->data[text->size - 1];
     if (last_char == '\n') {
-      block_text = std::string((char*) text->data, text->size - 1);
+      block_text = NodeString((char*) text->data, text->size - 1);
     } else {
       block_text = hoedown_buffer_to_string(text);
     }
+    count_node(data);
     collector->push_back(new FixedWidthBlockNode(block_text));
   }
 }
 
 static void gb_markdown_header(hoedown_buffer *ob, const hoedown_buffer *content, int level,
                                const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_HEADER);
+  if (halted(data)) {
+    return;
+  }
   auto collector = get_collector(data);
   if (content->size == 0 && collector->empty() == false) {
     TextNode* tn = dynamic_cast<TextNode*>(collector->back());
@@ -146,6 +274,7 @@ static void gb_markdown_header(hoedown_buffer *ob, const hoedown_buffer *content
   }
   else {
     if (content->size > 0) {
+      count_node(data);
       HeaderNode* hn = new HeaderNode(hoedown_buffer_to_string(content), level);
       collector->push_back(hn);
     }
@@ -161,10 +290,12 @@ static bool is_valid_paragraph_child(NodeType type) {
 }
 
 static void gb_markdown_paragraph(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_PARAGRAPH);
   auto collector = get_collector(data);
-  if (collector->empty()) {
+  if (collector->empty() || halted(data)) {
     return;
   }
+  count_node(data);
   ParagraphNode* pn = new ParagraphNode();
   while (!collector->empty()) {
     auto last_node = collector->back();
@@ -174,6 +305,7 @@ static void gb_markdown_paragraph(hoedown_buffer *ob, const hoedown_buffer *cont
     }
     collector->pop_back();
     if (last_node->line_terminator()) {
+      count_node(data);
       pn->add_child(new EOLNode());
     }
     pn->add_child(last_node);
@@ -182,30 +314,39 @@ static void gb_markdown_paragraph(hoedown_buffer *ob, const hoedown_buffer *cont
     delete pn;
   } else {
     pn->terminates_line(true);
-    collector->push_back(pn);
+    push_container(collector, pn, data);
+    block_done(ob, data);
   }
 }
 
 static int gb_markdown_autolink(hoedown_buffer *ob, const hoedown_buffer *link, hoedown_autolink_type type, const hoedown_renderer_data *data) {
-  if (link == nullptr) {
+  note_callback(data, greenbar::CB_AUTOLINK);
+  if (link == nullptr || halted(data)) {
     return 1;
   }
   auto collector = get_collector(data);
   auto link_text = hoedown_buffer_to_string(link);
+  count_node(data);
   collector->push_back(new LinkNode(link_text, link_text));
   return 1;
 }
 
 static int gb_markdown_codespan(hoedown_buffer *ob, const hoedown_buffer *text, const hoedown_renderer_data *data) {
-  if (text == nullptr || text->size == 0 || (text->size == 1 && text->data[0] == '\n')) {
+  note_callback(data, greenbar::CB_CODESPAN);
+  if (text == nullptr || text->size == 0 || (text->size == 1 && text->data[0] == '\n') || halted(data)) {
     return 1;
   }
   auto collector = get_collector(data);
+  count_node(data);
   collector->push_back(new FixedWidthNode(hoedown_buffer_to_string(text)));
   return 1;
 }
 
 static int gb_markdown_emphasis(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_EMPHASIS);
+  if (halted(data)) {
+    return 1;
+  }
   auto collector = get_collector(data);
   if (content == nullptr || content->size == 0) {
     TextNode* tn = dynamic_cast<TextNode*>(collector->back());
@@ -217,12 +358,17 @@ static int gb_markdown_emphasis(hoedown_buffer *ob, const hoedown_buffer *conten
     }
   } else {
     auto collector = get_collector(data);
+    count_node(data);
     collector->push_back(new ItalicsNode(hoedown_buffer_to_string(content)));
   }
   return 1;
 }
 
 static int gb_markdown_double_emphasis(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_DOUBLE_EMPHASIS);
+  if (halted(data)) {
+    return 1;
+  }
   auto collector = get_collector(data);
   if (content == nullptr || content->size == 0) {
     TextNode* tn = dynamic_cast<TextNode*>(collector->back());
@@ -233,21 +379,51 @@ static int gb_markdown_double_emphasis(hoedown_buffer *ob, const hoedown_buffer
       delete tn;
     }
   } else {
+    count_node(data);
     collector->push_back(new BoldNode(hoedown_buffer_to_string(content)));
   }
   return 1;
 }
 
+static int gb_markdown_strikethrough(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_STRIKETHROUGH);
+  if (halted(data)) {
+    return 1;
+  }
+  auto collector = get_collector(data);
+  if (content == nullptr || content->size == 0) {
+    if (collector->empty()) {
+      return 1;
+    }
+    TextNode* tn = dynamic_cast<TextNode*>(collector->back());
+    if (tn) {
+      StrikethroughNode* sn = tn->to_strikethrough();
+      collector->pop_back();
+      collector->push_back(sn);
+      delete tn;
+    }
+  } else {
+    count_node(data);
+    collector->push_back(new StrikethroughNode(hoedown_buffer_to_string(content)));
+  }
+  return 1;
+}
+
 static int gb_markdown_link(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_buffer *url, const hoedown_buffer *link,
                             const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_LINK);
+  if (halted(data)) {
+    return 1;
+  }
   auto collector = get_collector(data);
   MarkdownNode* last_node = nullptr;
   if (!collector->empty()) {
     last_node = collector->back();
   }
   if (last_node == nullptr || last_node->get_type() != MD_TEXT) {
-    std::string url_text = hoedown_buffer_to_string(url);
-    std::string link_text = hoedown_buffer_to_string(link);
+    NodeString url_text = hoedown_buffer_to_string(url);
+    NodeString link_text = hoedown_buffer_to_string(link);
+    count_node(data);
     collector->push_back(new LinkNode(link_text, url_text));
   } else {
     TextNode* tn = dynamic_cast<TextNode*>(last_node);
@@ -263,6 +439,7 @@ static int gb_markdown_link(hoedown_buffer *ob, const hoedown_buffer *content, c
 }
 
 static int gb_markdown_linebreak(hoedown_buffer *ob, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_LINEBREAK);
    auto collector = get_collector(data);
    if (!collector->empty()) {
      auto last_node = collector->back();
@@ -272,7 +449,8 @@ static int gb_markdown_linebreak(hoedown_buffer *ob, const hoedown_renderer_data
  }
 
 static void gb_markdown_normal_text(hoedown_buffer *ob, const hoedown_buffer *text, const hoedown_renderer_data *data) {
-  if (text == nullptr) {
+  note_callback(data, greenbar::CB_NORMAL_TEXT);
+  if (text == nullptr || halted(data)) {
     return;
   }
   TextNode* tn = nullptr;
@@ -305,13 +483,19 @@ static void gb_markdown_normal_text(hoedown_buffer *ob, const hoedown_buffer *te
   if (tn == nullptr) {
     return;
   }
+  count_node(data);
   collector->push_back(tn);
 }
 
 static void gb_markdown_list(hoedown_buffer *ob, const hoedown_buffer *content,
                              hoedown_list_flags flags, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_LIST);
+  if (halted(data)) {
+    return;
+  }
   auto collector = get_collector(data);
   MarkdownNodeContainer *list = nullptr;
+  count_node(data);
   if (flags & HOEDOWN_LIST_ORDERED) {
     list = new OrderedListNode();
   } else {
@@ -328,19 +512,24 @@ static void gb_markdown_list(hoedown_buffer *ob, const hoedown_buffer *content,
   if (list->empty()) {
     delete list;
   } else {
-    collector->push_back(list);
+    push_container(collector, list, data);
   }
 }
 
 static void gb_markdown_listitem(hoedown_buffer *ob, const hoedown_buffer *content, hoedown_list_flags flags, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_LISTITEM);
+  if (halted(data)) {
+    return;
+  }
   auto collector = get_collector(data);
+  if (!collector->empty() && collector->back()->get_type() == MD_LIST_ITEM) {
+    return;
+  }
+  count_node(data);
   auto item = new ListItemNode();
   if (!collector->empty()) {
     auto first_child = collector->back();
     auto first_child_type = first_child->get_type();
-    if (first_child_type == MD_LIST_ITEM) {
-      return;
-    }
     collector->pop_back();
     item->add_child(first_child);
     while (!collector->empty()) {
@@ -364,23 +553,26 @@ static void gb_markdown_listitem(hoedown_buffer *ob, const hoedown_buffer *conte
   if (item->empty()) {
     delete item;
   } else {
-    collector->push_back(item);
+    push_container(collector, item, data);
   }
 }
 
 
 static void gb_markdown_table(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_TABLE);
   auto collector = get_collector(data);
-  if (collector->empty()) {
+  if (collector->empty() || halted(data)) {
     return;
   }
   bool has_header = false;
+  count_node(data);
   TableNode* table = new TableNode();
   auto child = collector->back();
   while (child->get_type() == MD_TABLE_HEADER || child->get_type() == MD_TABLE_ROW) {
     collector->pop_back();
     if (child->get_type() == MD_TABLE_HEADER) {
       has_header = true;
+      delete child;
     } else {
       table->add_child(child);
     }
@@ -395,22 +587,26 @@ static void gb_markdown_table(hoedown_buffer *ob, const hoedown_buffer *content,
   if (table->empty()) {
     delete table;
   } else {
-    collector->push_back(table);
+    push_container(collector, table, data);
   }
 }
 static void gb_markdown_table_header(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_TABLE_HEADER);
   auto collector = get_collector(data);
-  if (collector->empty()) {
+  if (collector->empty() || halted(data)) {
     return;
   }
+  count_node(data);
   collector->push_back(new TableHeaderNode());
 }
 
 static void gb_markdown_table_row(hoedown_buffer *ob, const hoedown_buffer *content, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_TABLE_ROW);
   auto collector = get_collector(data);
-  if (collector->empty()) {
+  if (collector->empty() || halted(data)) {
     return;
   }
+  count_node(data);
   TableRowNode* row = new TableRowNode();
   while (!collector->empty()) {
     auto child = collector->back();
@@ -424,15 +620,31 @@ static void gb_markdown_table_row(hoedown_buffer *ob, const hoedown_buffer *cont
   if (row->empty()) {
     delete row;
   } else {
-    collector->push_back(row);
+    push_container(collector, row, data);
   }
 }
 
+static NodeAlignment alignment_from_flags(unsigned int flags) {
+  NodeAlignment alignment = ALIGN_NONE;
+  if (flags & HOEDOWN_TABLE_ALIGN_LEFT) {
+    alignment = ALIGN_LEFT;
+  }
+  if (flags & HOEDOWN_TABLE_ALIGN_RIGHT) {
+    alignment = ALIGN_RIGHT;
+  }
+  if (flags & HOEDOWN_TABLE_ALIGN_CENTER) {
+    alignment = ALIGN_CENTER;
+  }
+  return alignment;
+}
+
 static void gb_markdown_table_cell(hoedown_buffer *ob, const hoedown_buffer *content, hoedown_table_flags flags, const hoedown_renderer_data *data) {
+  note_callback(data, greenbar::CB_TABLE_CELL);
   auto collector = get_collector(data);
-  if (collector->empty()) {
+  if (collector->empty() || halted(data)) {
     return;
   }
+  count_node(data);
   TableCellNode* cell = new TableCellNode();
   bool table_done = false;
   while (!collector->empty() && !table_done) {
@@ -450,16 +662,72 @@ static void gb_markdown_table_cell(hoedown_buffer *ob, const hoedown_buffer *con
       cell->add_child(child);
     }
   }
-  NodeAlignment alignment = ALIGN_NONE;
-  if (flags & HOEDOWN_TABLE_ALIGN_LEFT) {
-    alignment = ALIGN_LEFT;
-  }
-  if (flags & HOEDOWN_TABLE_ALIGN_RIGHT) {
-    alignment = ALIGN_RIGHT;
+  cell->put_attribute(ATTR_ALIGNMENT, AttributeValue((int) alignment_from_flags(flags)));
+  push_container(collector, cell, data);
+}
+
+namespace greenbar {
+
+  bool accepts_table(markdown_analyzer* analyzer) {
+    auto collector = get_collector(analyzer);
+    if (collector->empty()) {
+      return true;
+    }
+    // Anything else would be absorbed by the first cell
+    switch(collector->back()->get_type()) {
+    case MD_PARAGRAPH:
+    case MD_TABLE_CELL:
+    case MD_TABLE_ROW:
+    case MD_TABLE_HEADER:
+    case MD_TABLE:
+      return true;
+    default:
+      return false;
+    }
   }
-  if (flags & HOEDOWN_TABLE_ALIGN_CENTER) {
-    alignment = ALIGN_CENTER;
+
+  void build_table(markdown_analyzer* analyzer, const uint8_t* text, const PipeTable& table) {
+    hoedown_renderer_data renderer_data;
+    renderer_data.opaque = analyzer->opaque;
+    auto data = &renderer_data;
+    if (halted(data)) {
+      return;
+    }
+    auto profile = ((AnalyzerState*) analyzer->opaque)->profile;
+    if (profile != nullptr) {
+      profile->fast_tables++;
+    }
+    // Count the table and header marker the way the callbacks do
+    count_node(data);
+    count_node(data);
+    std::vector<TableRowNode*, TrackedAllocator<TableRowNode*> > rows;
+    size_t row_count = table.cells.size() / table.columns;
+    for (size_t r = 0; r < row_count && !halted(data); r++) {
+      unsigned int header_flag = r == 0 ? HOEDOWN_TABLE_HEADER : 0;
+      count_node(data);
+      auto row = new TableRowNode();
+      // Children are kept in reverse document order
+      for (size_t c = table.columns; c > 0; c--) {
+        auto span = table.cells[r * table.columns + c - 1];
+        count_node(data);
+        count_node(data);
+        auto cell = new TableCellNode();
+        cell->add_child(new TextNode(NodeString((char*) text + span.begin, span.end - span.begin)));
+        cell->put_attribute(ATTR_ALIGNMENT, AttributeValue((int) alignment_from_flags(table.column_flags[c - 1] | header_flag)));
+        row->add_child(cell);
+      }
+      rows.push_back(row);
+    }
+    auto node = new TableNode();
+    for (size_t r = rows.size(); r > 0; r--) {
+      node->add_child(rows[r - 1]);
+    }
+    if (node->empty()) {
+      delete node;
+      return;
+    }
+    node->mark_header();
+    push_container(get_collector(analyzer), node, data);
   }
-  cell->put_attribute(ATTR_ALIGNMENT, AttributeValue((int) alignment));
-  collector->push_back(cell);
+
 }
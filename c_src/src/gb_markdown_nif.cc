@@ -19,28 +19,80 @@
 //
 // ------------------------------------------------------------------
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <mutex>
+#include <new>
 #include <string>
+#include <unordered_set>
 
 #include "erl_nif.h"
 #include "buffer.h"
 #include "gb_common.hpp"
+#include "gb_json.hpp"
 #include "markdown_analyzer.hpp"
+#include "markdown_parser.hpp"
+#include "gb_term_builder.hpp"
+#include "gb_memory.hpp"
+#include "gb_slowlog.hpp"
+#include "gb_stats.hpp"
+#include "gb_trace.hpp"
 
 // Prototype
 #define NIF(name) \
   ERL_NIF_TERM name(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 
-// Preferred write size for hoedown's output buffer
-#define OUTPUT_SIZE 128
-
 // NIF function forward declares
 NIF(gb_parse);
+NIF(gb_parse_with_options);
+NIF(gb_new_parser);
+NIF(gb_parse_with_parser);
+NIF(gb_stats);
+NIF(gb_profile);
+NIF(gb_slow_parses);
+NIF(gb_configure_slow_parses);
+NIF(gb_stream);
+NIF(gb_parse_file);
+NIF(gb_ring_new);
+NIF(gb_ring_submit);
+NIF(gb_ring_take);
+
+// Page faults on mapped files can block, so files are parsed off the normal schedulers
+#ifdef ERL_NIF_DIRTY_SCHEDULER_SUPPORT
+#define GB_FILE_FLAGS ERL_NIF_DIRTY_JOB_IO_BOUND
+#else
+#define GB_FILE_FLAGS 0
+#endif
+
+// Streams are meant for long documents, parsed whole in one call
+#ifdef ERL_NIF_DIRTY_SCHEDULER_SUPPORT
+#define GB_STREAM_FLAGS ERL_NIF_DIRTY_JOB_CPU_BOUND
+#else
+#define GB_STREAM_FLAGS 0
+#endif
 
 
 static ErlNifFunc nif_funcs[] =
 {
-  {"parse", 1, gb_parse, 0}
+  {"parse", 1, gb_parse, 0},
+  {"parse_with_options", 2, gb_parse_with_options, 0},
+  {"new_parser", 1, gb_new_parser, 0},
+  {"parse_with_parser", 2, gb_parse_with_parser, 0},
+  {"stats", 0, gb_stats, 0},
+  {"profile", 1, gb_profile, 0},
+  {"slow_parses", 0, gb_slow_parses, 0},
+  {"configure_slow_parses", 1, gb_configure_slow_parses, 0},
+  {"stream", 4, gb_stream, GB_STREAM_FLAGS},
+  {"parse_file", 3, gb_parse_file, GB_FILE_FLAGS},
+  {"ring_new", 1, gb_ring_new, 0},
+  {"ring_submit", 3, gb_ring_submit, 0},
+  {"ring_take", 1, gb_ring_take, 0}
 };
 
 static ERL_NIF_TERM make_atom(ErlNifEnv* env, const char* name) {
@@ -51,13 +103,173 @@ static ERL_NIF_TERM make_atom(ErlNifEnv* env, const char* name) {
   return atom;
 }
 
-static int on_load(ErlNifEnv* env, void** priv, ERL_NIF_TERM load_info) {
+// Parse memory is allocated from the VM so erlang:memory/0 accounts for it
+static const greenbar::Allocator enif_allocator = {enif_alloc, enif_realloc, enif_free};
+
+#define GB_STRINGIFY(x) #x
+#define GB_RESOURCE_NAME(version) "gb_parser_v" GB_STRINGIFY(version)
+#define GB_RING_RESOURCE_NAME(version) "gb_ring_v" GB_STRINGIFY(version)
+
+// Attempts at an unused shared memory name before giving up
+#define GB_RING_NAME_TRIES 16
+
+// Parsers this library instance built for handles. After an upgrade the
+// successor owns the handles, so whatever is left here is freed on unload.
+static std::mutex handle_parsers_lock;
+static std::unordered_set<greenbar::MarkdownParser*> handle_parsers;
+
+// Generation of this library instance, set when it loads
+static uint32_t instance_generation;
+
+static greenbar::MarkdownParser* new_handle_parser(const greenbar::ParserConfig& config) {
+  auto parser = new greenbar::MarkdownParser(config);
+  std::lock_guard<std::mutex> guard(handle_parsers_lock);
+  handle_parsers.insert(parser);
+  return parser;
+}
+
+static void free_parser_res(ErlNifEnv* env, void* obj) {
+  gb_parser_res* res = (gb_parser_res*) obj;
+  // A handle last used before an upgrade points at a parser of a replaced
+  // instance, which that instance's on_unload frees. Its address may have
+  // been reused by one of ours since, so only the generation tells.
+  if (res->generation.load(std::memory_order_acquire) != instance_generation) {
+    return;
+  }
+  greenbar::MarkdownParser* parser = res->parser.load(std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> guard(handle_parsers_lock);
+    handle_parsers.erase(parser);
+  }
+  delete parser;
+}
+
+static void free_ring_res(ErlNifEnv* env, void* obj) {
+  gb_ring_res* res = (gb_ring_res*) obj;
+  greenbar::ring::unmap(&res->segment);
+  // The worker removes the name when it attaches, unless it never started
+  if (res->name[0] != '\0') {
+    shm_unlink(res->name);
+  }
+  res->~gb_ring_res();
+}
+
+// Parser for a handle, rebuilt when the handle was created by an older
+// library instance. A newer instance's parser outlives this one, so it is
+// used as is.
+static greenbar::MarkdownParser* handle_parser(gb_parser_res* res, gb_priv_s* priv_data) {
+  if (res->generation.load(std::memory_order_acquire) >= priv_data->generation) {
+    return res->parser.load(std::memory_order_relaxed);
+  }
+  enif_mutex_lock(priv_data->handle_lock);
+  if (res->generation.load(std::memory_order_relaxed) < priv_data->generation) {
+    res->parser.store(new_handle_parser(res->config), std::memory_order_relaxed);
+    res->generation.store(priv_data->generation, std::memory_order_release);
+  }
+  enif_mutex_unlock(priv_data->handle_lock);
+  return res->parser.load(std::memory_order_relaxed);
+}
+
+static void export_slow_log(greenbar::SlowLogConfig* config, std::vector<greenbar::SlowParse>* entries) {
+  *config = greenbar::slowlog::config();
+  greenbar::slowlog::entries(entries);
+}
+
+static int64_t now_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Passes what this instance recorded after handing its state over to the
+// successor, so calls still served by old code aren't lost
+static void hand_over_late_state(gb_priv_s* priv_data) {
+  greenbar::StatsSnapshot totals;
+  greenbar::stats::snapshot(&totals);
+  greenbar::stats::subtract(&totals, priv_data->handoff_stats);
+  priv_data->successor->absorb_stats(totals);
+  std::vector<greenbar::SlowParse> entries;
+  std::vector<greenbar::SlowParse> late;
+  greenbar::slowlog::entries(&entries);
+  for (auto& entry : entries) {
+    if (entry.at_ms >= priv_data->handoff_ms) {
+      late.push_back(entry);
+    }
+  }
+  priv_data->successor->merge_slow_log(late);
+}
+
+// Private data of an instance this one can take state over from
+static gb_priv_s* compatible_priv(void* old) {
+  gb_priv_s* old_priv = (gb_priv_s*) old;
+  if (old_priv == NULL || old_priv->magic != GB_PRIV_MAGIC || old_priv->version != GB_PRIV_VERSION) {
+    return NULL;
+  }
+  return old_priv;
+}
+
+static int init_priv(ErlNifEnv* env, void** priv, gb_priv_s* old_priv) {
   gb_priv_s* priv_data = (gb_priv_s*) enif_alloc(sizeof(gb_priv_s));
 
   // Allocating private data failed, so abort loading the NIF
   if (priv_data == NULL) {
     return 1;
   }
+  priv_data->magic = GB_PRIV_MAGIC;
+  priv_data->version = GB_PRIV_VERSION;
+  priv_data->successor = NULL;
+  priv_data->export_stats = greenbar::stats::snapshot;
+  priv_data->absorb_stats = greenbar::stats::absorb;
+  priv_data->export_slow_log = export_slow_log;
+  priv_data->merge_slow_log = greenbar::slowlog::merge;
+  if (old_priv != NULL) {
+    priv_data->generation = old_priv->generation + 1;
+    priv_data->handle_lock = old_priv->handle_lock;
+  } else {
+    priv_data->generation = 1;
+    priv_data->handle_lock = enif_mutex_create((char*) "gb_handle_lock");
+    if (priv_data->handle_lock == NULL) {
+      enif_free(priv_data);
+      return 1;
+    }
+  }
+
+  // Handles of a compatible instance are taken over and rebuilt lazily.
+  // Other layouts get their own type name and stay with the old instance.
+  priv_data->gb_parser_type = enif_open_resource_type(env, NULL, GB_RESOURCE_NAME(GB_PRIV_VERSION), free_parser_res,
+                                                      (ErlNifResourceFlags) (ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER),
+                                                      NULL);
+  // Rings are only unmapped, so they are taken over the same way
+  priv_data->gb_ring_type = enif_open_resource_type(env, NULL, GB_RING_RESOURCE_NAME(GB_PRIV_VERSION), free_ring_res,
+                                                    (ErlNifResourceFlags) (ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER),
+                                                    NULL);
+  if (priv_data->gb_parser_type == NULL || priv_data->gb_ring_type == NULL) {
+    if (old_priv == NULL) {
+      enif_mutex_destroy(priv_data->handle_lock);
+    }
+    enif_free(priv_data);
+    return 1;
+  }
+  greenbar::memory::set_allocator(&enif_allocator);
+  priv_data->default_parser = new greenbar::MarkdownParser(greenbar::ParserConfig());
+  greenbar::ParserConfig html_config;
+  html_config.output = greenbar::OUTPUT_HTML;
+  priv_data->html_parser = new greenbar::MarkdownParser(html_config);
+
+  if (old_priv != NULL) {
+    // Carry counters over and start with as many ready documents as the
+    // old instance had idle, so the upgrade doesn't cost a cold start
+    old_priv->handoff_ms = now_ms();
+    old_priv->export_stats(&old_priv->handoff_stats);
+    greenbar::stats::absorb(old_priv->handoff_stats);
+    greenbar::SlowLogConfig slow_config;
+    std::vector<greenbar::SlowParse> slow_parses;
+    old_priv->export_slow_log(&slow_config, &slow_parses);
+    greenbar::slowlog::restore(slow_config, slow_parses);
+    priv_data->default_parser->warm(old_priv->default_parser->idle());
+    priv_data->html_parser->warm(old_priv->html_parser->idle());
+    old_priv->successor = priv_data;
+  }
+  instance_generation = priv_data->generation;
 
   // Frequently used atoms
   priv_data->gb_atom_ok = make_atom(env, "ok");
@@ -74,6 +286,7 @@ static int on_load(ErlNifEnv* env, void** priv, ERL_NIF_TERM load_info) {
   priv_data->gb_atom_header = make_atom(env, "header");
   priv_data->gb_atom_italics = make_atom(env, "italics");
   priv_data->gb_atom_bold = make_atom(env, "bold");
+  priv_data->gb_atom_strikethrough = make_atom(env, "strikethrough");
   priv_data->gb_atom_link = make_atom(env, "link");
   priv_data->gb_atom_level = make_atom(env, "level");
   priv_data->gb_atom_url = make_atom(env, "url");
@@ -88,21 +301,219 @@ static int on_load(ErlNifEnv* env, void** priv, ERL_NIF_TERM load_info) {
   priv_data->gb_atom_left = make_atom(env, "left");
   priv_data->gb_atom_right = make_atom(env, "right");
   priv_data->gb_atom_center = make_atom(env, "center");
+  priv_data->gb_atom_limit_exceeded = make_atom(env, "limit_exceeded");
+  priv_data->gb_atom_input_size = make_atom(env, "input_size");
+  priv_data->gb_atom_nodes = make_atom(env, "nodes");
+  priv_data->gb_atom_nesting = make_atom(env, "nesting");
+  priv_data->gb_atom_timeout = make_atom(env, "timeout");
+  priv_data->gb_atom_max_input_size = make_atom(env, "max_input_size");
+  priv_data->gb_atom_max_nodes = make_atom(env, "max_nodes");
+  priv_data->gb_atom_max_nesting = make_atom(env, "max_nesting");
+  priv_data->gb_atom_extensions = make_atom(env, "extensions");
+  priv_data->gb_atom_output = make_atom(env, "output");
+  priv_data->gb_atom_tree = make_atom(env, "tree");
+  priv_data->gb_atom_pool_size = make_atom(env, "pool_size");
+  priv_data->gb_atom_greenbar_parser = make_atom(env, "greenbar_parser");
+  priv_data->gb_atom_none = make_atom(env, "none");
+  priv_data->gb_atom_alignments = make_atom(env, "alignments");
+  priv_data->gb_atom_rows = make_atom(env, "rows");
+  priv_data->gb_atom_row_batches = make_atom(env, "row_batches");
+  priv_data->gb_atom_tables = make_atom(env, "tables");
+  priv_data->gb_atom_columnar = make_atom(env, "columnar");
+  priv_data->gb_atom_table_batch_size = make_atom(env, "table_batch_size");
+  priv_data->gb_atom_calls = make_atom(env, "calls");
+  priv_data->gb_atom_input_bytes = make_atom(env, "input_bytes");
+  priv_data->gb_atom_errors = make_atom(env, "errors");
+  priv_data->gb_atom_limits = make_atom(env, "limits");
+  priv_data->gb_atom_pool = make_atom(env, "pool");
+  priv_data->gb_atom_hits = make_atom(env, "hits");
+  priv_data->gb_atom_misses = make_atom(env, "misses");
+  priv_data->gb_atom_parse_us = make_atom(env, "parse_us");
+  priv_data->gb_atom_convert_us = make_atom(env, "convert_us");
+  priv_data->gb_atom_infinity = make_atom(env, "infinity");
+  priv_data->gb_atom_memory = make_atom(env, "memory");
+  priv_data->gb_atom_peak_kb = make_atom(env, "peak_kb");
+  priv_data->gb_atom_intern_strings = make_atom(env, "intern_strings");
+  priv_data->gb_atom_true = make_atom(env, "true");
+  priv_data->gb_atom_false = make_atom(env, "false");
+  priv_data->gb_atom_html = make_atom(env, "html");
+  priv_data->gb_atom_json = make_atom(env, "json");
+  priv_data->gb_atom_normalize_whitespace = make_atom(env, "normalize_whitespace");
+  priv_data->gb_atom_page_bytes = make_atom(env, "page_bytes");
+  priv_data->gb_atom_pages = make_atom(env, "pages");
 
   *priv = (void *) priv_data;
   return 0;
 }
 
+static int on_load(ErlNifEnv* env, void** priv, ERL_NIF_TERM load_info) {
+  return init_priv(env, priv, NULL);
+}
+
 static int on_upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info) {
-  return on_load(env, priv_data, load_info);
+  return init_priv(env, priv_data, compatible_priv(*old_priv_data));
 }
 
 static void on_unload(ErlNifEnv* env, void* priv) {
+  gb_priv_s* priv_data = (gb_priv_s*) priv;
+  delete priv_data->default_parser;
+  delete priv_data->html_parser;
+  if (priv_data->successor != NULL) {
+    hand_over_late_state(priv_data);
+    // The successor destroys handles now, and never these parsers
+    std::lock_guard<std::mutex> guard(handle_parsers_lock);
+    for (auto parser : handle_parsers) {
+      delete parser;
+    }
+    handle_parsers.clear();
+  } else {
+    enif_mutex_destroy(priv_data->handle_lock);
+  }
   enif_free(priv);
 }
 
-static ERL_NIF_TERM convert_results(ErlNifEnv *env, greenbar::node2::NodeVector *collector) {
+// Parses a list of extension names into hoedown extension flags
+static bool parse_extensions(ErlNifEnv* env, ERL_NIF_TERM names, unsigned int* extensions) {
   ERL_NIF_TERM head, tail;
+  char name[32];
+  unsigned int flags = 0;
+  unsigned int flag;
+  tail = names;
+  while (enif_get_list_cell(env, tail, &head, &tail)) {
+    if (!enif_get_atom(env, head, name, sizeof(name), ERL_NIF_LATIN1) || !greenbar::extension_flag(name, &flag)) {
+      return false;
+    }
+    flags |= flag;
+  }
+  if (!enif_is_list(env, tail)) {
+    return false;
+  }
+  *extensions = flags;
+  return true;
+}
+
+// Parses a proplist of parser options, e.g. [{max_nodes, 10000}, {timeout, 50}]
+static bool parse_options(ErlNifEnv* env, ERL_NIF_TERM options, gb_priv_s* priv_data, greenbar::ParserConfig* config) {
+  ERL_NIF_TERM head, tail;
+  greenbar::ParseLimits* limits = &config->limits;
+  tail = options;
+  while (enif_get_list_cell(env, tail, &head, &tail)) {
+    int arity;
+    const ERL_NIF_TERM* option;
+    unsigned long value;
+    if (!enif_get_tuple(env, head, &arity, &option) || arity != 2) {
+      return false;
+    }
+    if (enif_is_identical(option[0], priv_data->gb_atom_extensions)) {
+      if (!parse_extensions(env, option[1], &config->extensions)) {
+        return false;
+      }
+      continue;
+    }
+    if (enif_is_identical(option[0], priv_data->gb_atom_output)) {
+      if (enif_is_identical(option[1], priv_data->gb_atom_tree)) {
+        config->output = greenbar::OUTPUT_TREE;
+      } else if (enif_is_identical(option[1], priv_data->gb_atom_html)) {
+        config->output = greenbar::OUTPUT_HTML;
+      } else if (enif_is_identical(option[1], priv_data->gb_atom_json)) {
+        config->output = greenbar::OUTPUT_JSON;
+      } else {
+        return false;
+      }
+      continue;
+    }
+    if (enif_is_identical(option[0], priv_data->gb_atom_intern_strings)) {
+      if (enif_is_identical(option[1], priv_data->gb_atom_true)) {
+        config->intern_strings = true;
+      } else if (enif_is_identical(option[1], priv_data->gb_atom_false)) {
+        config->intern_strings = false;
+      } else {
+        return false;
+      }
+      continue;
+    }
+    if (enif_is_identical(option[0], priv_data->gb_atom_normalize_whitespace)) {
+      if (enif_is_identical(option[1], priv_data->gb_atom_true)) {
+        config->normalize_whitespace = true;
+      } else if (enif_is_identical(option[1], priv_data->gb_atom_false)) {
+        config->normalize_whitespace = false;
+      } else {
+        return false;
+      }
+      continue;
+    }
+    if (enif_is_identical(option[0], priv_data->gb_atom_tables)) {
+      if (enif_is_identical(option[1], priv_data->gb_atom_columnar)) {
+        config->tables = greenbar::TABLES_COLUMNAR;
+      } else if (enif_is_identical(option[1], priv_data->gb_atom_tree)) {
+        config->tables = greenbar::TABLES_TREE;
+      } else {
+        return false;
+      }
+      continue;
+    }
+    if (!enif_get_ulong(env, option[1], &value)) {
+      return false;
+    }
+    if (enif_is_identical(option[0], priv_data->gb_atom_pool_size)) {
+      config->pool_size = value;
+    } else if (enif_is_identical(option[0], priv_data->gb_atom_table_batch_size)) {
+      config->table_batch_size = value;
+    } else if (enif_is_identical(option[0], priv_data->gb_atom_page_bytes)) {
+      config->page_bytes = value;
+    } else if (enif_is_identical(option[0], priv_data->gb_atom_max_input_size)) {
+      limits->max_input_size = value;
+    } else if (enif_is_identical(option[0], priv_data->gb_atom_max_nodes)) {
+      limits->max_nodes = value;
+    } else if (enif_is_identical(option[0], priv_data->gb_atom_max_nesting)) {
+      limits->max_nesting = value;
+    } else if (enif_is_identical(option[0], priv_data->gb_atom_timeout)) {
+      limits->timeout_ms = value;
+    } else {
+      return false;
+    }
+  }
+  // hoedown's HTML renderer has no node count or deadline checks, so a
+  // preview parser can't promise either
+  if (config->output == greenbar::OUTPUT_HTML && (limits->max_nodes > 0 || limits->timeout_ms > 0)) {
+    return false;
+  }
+  // Improper lists are rejected
+  return enif_is_list(env, tail);
+}
+
+static ERL_NIF_TERM limit_to_atom(greenbar::LimitType which, gb_priv_s* priv_data) {
+  switch(which) {
+  case greenbar::LIMIT_INPUT_SIZE:
+    return priv_data->gb_atom_input_size;
+  case greenbar::LIMIT_NODES:
+    return priv_data->gb_atom_nodes;
+  case greenbar::LIMIT_NESTING:
+    return priv_data->gb_atom_nesting;
+  default:
+    return priv_data->gb_atom_timeout;
+  }
+}
+
+static ERL_NIF_TERM limit_error(ErlNifEnv* env, greenbar::LimitType which, gb_priv_s* priv_data) {
+  return enif_make_tuple(env, 3, priv_data->gb_atom_error, priv_data->gb_atom_limit_exceeded,
+                         limit_to_atom(which, priv_data));
+}
+
+static ERL_NIF_TERM convert_results(ErlNifEnv *env, greenbar::node2::NodeVector *collector,
+                                    greenbar::LimitTracker *limits, const greenbar::ParserConfig& config,
+                                    greenbar::ParseProfile* profile) {
+  ERL_NIF_TERM head, tail;
+  greenbar::TermContext ctx;
+  ctx.env = env;
+  ctx.priv_data = (gb_priv_s*) enif_priv_data(env);
+  ctx.limits = limits;
+  ctx.tables = config.tables;
+  ctx.table_batch_size = config.table_batch_size;
+  ctx.profile = profile;
+  greenbar::StringTable strings;
+  ctx.strings = config.intern_strings ? &strings : nullptr;
+  ctx.page_bytes = config.page_bytes;
   tail = enif_make_list(env, 0);
   if (collector->size() < 1) {
     return tail;
@@ -119,44 +530,954 @@ static ERL_NIF_TERM convert_results(ErlNifEnv *env, greenbar::node2::NodeVector
         continue;
       }
     }
-    head = info->to_erl_term(env);
+    if (!limits->tick()) {
+      break;
+    }
+    head = greenbar::node_to_term(ctx, info);
     tail = enif_make_list_cell(env, head, tail);
   }
 
   return tail;
 }
 
+// Writes the tree as JSON into the document's unused output buffer and
+// makes it one binary. A tripped limit is left for the caller to report.
+// Returns false when the binary can't be allocated.
+static bool convert_json(ErlNifEnv *env, hoedown_buffer* ob, greenbar::node2::NodeVector *collector,
+                         greenbar::LimitTracker *limits, const greenbar::ParserConfig& config,
+                         greenbar::ParseProfile* profile, ERL_NIF_TERM* json) {
+  ob->size = 0;
+  if (!greenbar::collector_to_json(ob, collector, limits, config, profile)) {
+    *json = enif_make_list(env, 0);
+    return true;
+  }
+  unsigned char* out = enif_make_new_binary(env, ob->size, json);
+  if (out == NULL) {
+    return false;
+  }
+  memcpy(out, ob->data, ob->size);
+  return true;
+}
+
+// Markdown source borrowed from a binary or gathered from iodata
+typedef struct {
+  const uint8_t* data;
+  size_t size;
+} gb_input_s;
+
+// Appends a segment, growing the buffer at least twofold so a long
+// iolist doesn't reallocate once per unit
+static void gather(hoedown_buffer* scratch, const uint8_t* data, size_t size) {
+  if (scratch->size + size > scratch->asize) {
+    size_t want = scratch->asize * 2;
+    hoedown_buffer_grow(scratch, want > scratch->size + size ? want : scratch->size + size);
+  }
+  hoedown_buffer_put(scratch, data, size);
+}
+
+// hoedown needs the whole document in one buffer, so binaries are used in
+// place and iolists are walked element by element into the pooled
+// document's scratch buffer, the only copy made. An iolist holding a
+// single binary is used in place too.
+static bool get_input(ErlNifEnv* env, ERL_NIF_TERM text, hoedown_buffer* scratch, gb_input_s* input) {
+  ErlNifBinary bin;
+  if (enif_inspect_binary(env, text, &bin)) {
+    input->data = bin.data;
+    input->size = bin.size;
+    return true;
+  }
+  if (!enif_is_list(env, text)) {
+    return false;
+  }
+  // The first binary is only copied once a second segment shows up
+  const uint8_t* first = nullptr;
+  size_t first_size = 0;
+  size_t segments = 0;
+  scratch->size = 0;
+  auto add = [&](const uint8_t* data, size_t size, bool borrowed) {
+    if (size == 0) {
+      return;
+    }
+    if (segments == 0 && borrowed) {
+      first = data;
+      first_size = size;
+    } else {
+      if (segments == 1 && first != nullptr) {
+        gather(scratch, first, first_size);
+      }
+      gather(scratch, data, size);
+    }
+    segments++;
+  };
+  // Tails of the enclosing lists. Walked without recursion, as iolists
+  // built by appending nest as deep as they are long.
+  std::vector<ERL_NIF_TERM> outer;
+  ERL_NIF_TERM rest = text;
+  for (;;) {
+    ERL_NIF_TERM head, tail;
+    if (enif_get_list_cell(env, rest, &head, &tail)) {
+      int byte;
+      if (enif_is_list(env, head)) {
+        outer.push_back(tail);
+        rest = head;
+      } else if (enif_inspect_binary(env, head, &bin)) {
+        add(bin.data, bin.size, true);
+        rest = tail;
+      } else if (enif_get_int(env, head, &byte) && byte >= 0 && byte <= 255) {
+        uint8_t c = (uint8_t) byte;
+        add(&c, 1, false);
+        rest = tail;
+      } else {
+        return false;
+      }
+      continue;
+    }
+    // A list ends with [] or, in an iolist, a binary tail
+    if (enif_inspect_binary(env, rest, &bin)) {
+      add(bin.data, bin.size, true);
+    } else if (!enif_is_empty_list(env, rest)) {
+      return false;
+    }
+    if (outer.empty()) {
+      break;
+    }
+    rest = outer.back();
+    outer.pop_back();
+  }
+  if (segments == 1 && first != nullptr) {
+    input->data = first;
+    input->size = first_size;
+  } else if (segments == 0) {
+    input->data = (const uint8_t*) "";
+    input->size = 0;
+  } else {
+    input->data = scratch->data;
+    input->size = scratch->size;
+  }
+  return true;
+}
+
+static uint64_t elapsed_us(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+static void count_limit_hit(greenbar::LimitType which) {
+  switch(which) {
+  case greenbar::LIMIT_INPUT_SIZE:
+    greenbar::stats::add(greenbar::STAT_LIMIT_INPUT_SIZE);
+    break;
+  case greenbar::LIMIT_NODES:
+    greenbar::stats::add(greenbar::STAT_LIMIT_NODES);
+    break;
+  case greenbar::LIMIT_NESTING:
+    greenbar::stats::add(greenbar::STAT_LIMIT_NESTING);
+    break;
+  default:
+    greenbar::stats::add(greenbar::STAT_LIMIT_TIMEOUT);
+  }
+}
+
+// Copies an HTML document's output into a binary and releases the document
+static ERL_NIF_TERM html_result(ErlNifEnv* env, greenbar::MarkdownParser* parser, greenbar::PooledDocument* doc,
+                               size_t input_size, uint64_t render_us) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  ERL_NIF_TERM html;
+  unsigned char* out = enif_make_new_binary(env, doc->ob->size, &html);
+  if (out == NULL) {
+    parser->release(doc);
+    greenbar::stats::add(greenbar::STAT_ERRORS);
+    GB_TRACE_ERROR("out_of_memory");
+    return priv_data->gb_atom_out_of_memory;
+  }
+  memcpy(out, doc->ob->data, doc->ob->size);
+  parser->release(doc);
+  GB_TRACE_PARSE_DONE(input_size, 0, render_us);
+  return enif_make_tuple(env, 2, priv_data->gb_atom_ok, html);
+}
+
+// Renders input with an acquired document, converts the results and
+// releases the document
+static ERL_NIF_TERM parse_document(ErlNifEnv* env, greenbar::MarkdownParser* parser, const greenbar::ParserConfig& config,
+                                   greenbar::PooledDocument* doc, const gb_input_s& input,
+                                   greenbar::ParseProfile* profile) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  const greenbar::ParseLimits& limits = config.limits;
+  greenbar::stats::add(greenbar::STAT_INPUT_BYTES, input.size);
+  GB_TRACE_PARSE_START(input.size);
+  // Reject oversized input before doing any work
+  if (limits.max_input_size > 0 && input.size > limits.max_input_size) {
+    parser->release(doc);
+    count_limit_hit(greenbar::LIMIT_INPUT_SIZE);
+    GB_TRACE_LIMIT((int) greenbar::LIMIT_INPUT_SIZE, input.size, 0);
+    return limit_error(env, greenbar::LIMIT_INPUT_SIZE, priv_data);
+  }
+  auto started = std::chrono::steady_clock::now();
+  parser->render(doc, input.data, input.size, limits, profile);
+  uint64_t render_us = elapsed_us(started);
+  greenbar::stats::record(greenbar::HIST_PARSE_US, render_us);
+  if (doc->analyzer == nullptr) {
+    greenbar::slowlog::record(input.data, input.size, render_us, render_us, 0, greenbar::LIMIT_NONE);
+    return html_result(env, parser, doc, input.size, render_us);
+  }
+
+  auto tracker = greenbar::get_limits(doc->analyzer);
+  GB_TRACE_RENDER_DONE(input.size, tracker->node_count(), render_us);
+  ERL_NIF_TERM result;
+  uint64_t convert_us = 0;
+  if (!tracker->exceeded()) {
+    auto collector = greenbar::get_collector(doc->analyzer);
+    started = std::chrono::steady_clock::now();
+    if (config.output == greenbar::OUTPUT_JSON) {
+      if (!convert_json(env, doc->ob, collector, tracker, config, profile, &result)) {
+        parser->release(doc);
+        greenbar::stats::add(greenbar::STAT_ERRORS);
+        GB_TRACE_ERROR("out_of_memory");
+        return priv_data->gb_atom_out_of_memory;
+      }
+    } else {
+      result = convert_results(env, collector, tracker, config, profile);
+    }
+    convert_us = elapsed_us(started);
+    greenbar::stats::record(greenbar::HIST_CONVERT_US, convert_us);
+    GB_TRACE_CONVERT_DONE(tracker->node_count(), convert_us);
+    if (profile != nullptr) {
+      profile->convert_us = convert_us;
+    }
+  }
+  if (tracker->exceeded()) {
+    count_limit_hit(tracker->which());
+    GB_TRACE_LIMIT((int) tracker->which(), input.size, tracker->node_count());
+    result = limit_error(env, tracker->which(), priv_data);
+  } else {
+    GB_TRACE_PARSE_DONE(input.size, tracker->node_count(), render_us + convert_us);
+    result = enif_make_tuple(env, 2, priv_data->gb_atom_ok, result);
+  }
+  greenbar::slowlog::record(input.data, input.size, render_us + convert_us, render_us, tracker->node_count(),
+                            tracker->exceeded() ? tracker->which() : greenbar::LIMIT_NONE);
+  parser->release(doc);
+  return result;
+}
+
+static ERL_NIF_TERM parse_input(ErlNifEnv* env, greenbar::MarkdownParser* parser, const greenbar::ParserConfig& config,
+                                ERL_NIF_TERM text, greenbar::ParseProfile* profile) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  greenbar::stats::add(greenbar::STAT_CALLS);
+  auto doc = parser->acquire();
+  if (doc == nullptr) {
+    greenbar::stats::add(greenbar::STAT_ERRORS);
+    GB_TRACE_ERROR("out_of_memory");
+    return priv_data->gb_atom_out_of_memory;
+  }
+  gb_input_s input;
+  if (!get_input(env, text, doc->input, &input)) {
+    parser->release(doc);
+    greenbar::stats::add(greenbar::STAT_ERRORS);
+    GB_TRACE_ERROR("badarg");
+    return enif_make_badarg(env);
+  }
+  // The document is released, and its nodes with it, before the arena ends
+  if (input.size > GB_SMALL_INPUT) {
+    return parse_document(env, parser, config, doc, input, profile);
+  }
+  greenbar::memory::begin_arena();
+  ERL_NIF_TERM result = parse_document(env, parser, config, doc, input, profile);
+  greenbar::memory::end_arena();
+  return result;
+}
+
+// Parse input with a pooled document from parser, filling in profile when given
+static ERL_NIF_TERM run_parse(ErlNifEnv* env, greenbar::MarkdownParser* parser, const greenbar::ParserConfig& config,
+                              ERL_NIF_TERM text, greenbar::ParseProfile* profile = nullptr) {
+  greenbar::memory::begin_call();
+  ERL_NIF_TERM result = parse_input(env, parser, config, text, profile);
+  auto used = greenbar::memory::end_call();
+  greenbar::stats::record(greenbar::HIST_PEAK_KB, used.peak / 1024);
+  if (profile != nullptr) {
+    profile->peak_bytes = used.peak;
+  }
+  return result;
+}
+
+// Read-only mapping of a whole file
+typedef struct {
+  void* addr;
+  size_t size;
+} gb_mapping_s;
+
+// Checks that fd is a regular file of at most max_size bytes, returning 0
+// or an errno value
+static int check_file(int fd, size_t max_size, struct stat* info) {
+  if (fstat(fd, info) != 0) {
+    return errno;
+  }
+  if (S_ISDIR(info->st_mode)) {
+    return EISDIR;
+  }
+  // Pipes and devices have no size to read or map up front
+  if (!S_ISREG(info->st_mode)) {
+    return EINVAL;
+  }
+  if (max_size > 0 && (uint64_t) info->st_size > max_size) {
+    return EFBIG;
+  }
+  return 0;
+}
+
+// Reads all of path into buf, returning 0 or an errno value. The size
+// fstat gives is only a hint, so a file changing underneath yields what
+// the reads returned rather than a fault.
+static int read_file(const char* path, size_t max_size, hoedown_buffer* buf) {
+  buf->size = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return errno;
+  }
+  struct stat info;
+  int error = check_file(fd, max_size, &info);
+  if (error == 0) {
+    // A byte to spare so the end shows up without growing
+    hoedown_buffer_grow(buf, (size_t) info.st_size + 1);
+  }
+  while (error == 0) {
+    if (buf->size == buf->asize) {
+      hoedown_buffer_grow(buf, buf->asize * 2);
+    }
+    ssize_t count = pread(fd, buf->data + buf->size, buf->asize - buf->size, (off_t) buf->size);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      error = errno;
+    } else if (count == 0) {
+      break;
+    } else {
+      buf->size += (size_t) count;
+      if (max_size > 0 && buf->size > max_size) {
+        error = EFBIG;
+      }
+    }
+  }
+  close(fd);
+  return error;
+}
+
+// Maps path, returning 0 or an errno value. Empty files aren't mapped.
+// Truncating the file while it is mapped raises SIGBUS on the next read
+// past the new end, which takes the whole VM down.
+static int map_file(const char* path, size_t max_size, gb_mapping_s* mapping) {
+  mapping->addr = NULL;
+  mapping->size = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return errno;
+  }
+  struct stat info;
+  int error = check_file(fd, max_size, &info);
+  if (error == 0 && info.st_size > 0) {
+    void* addr = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      error = errno;
+    } else {
+      madvise(addr, (size_t) info.st_size, MADV_SEQUENTIAL);
+      mapping->addr = addr;
+      mapping->size = (size_t) info.st_size;
+    }
+  }
+  close(fd);
+  return error;
+}
+
+static ERL_NIF_TERM errno_to_atom(ErlNifEnv* env, int error) {
+  switch(error) {
+  case ENOENT:
+    return make_atom(env, "enoent");
+  case EACCES:
+    return make_atom(env, "eacces");
+  case EISDIR:
+    return make_atom(env, "eisdir");
+  case ENOMEM:
+    return make_atom(env, "enomem");
+  case ENOTDIR:
+    return make_atom(env, "enotdir");
+  case ENAMETOOLONG:
+    return make_atom(env, "enametoolong");
+  case EMFILE:
+  case ENFILE:
+    return make_atom(env, "emfile");
+  case EINVAL:
+    return make_atom(env, "einval");
+  default:
+    return make_atom(env, "eio");
+  }
+}
+
+// Parses a file without making a binary of it. The file is read into the
+// pooled document's scratch buffer, or with map set parsed in place from a
+// mapping, which saves the copy but isn't safe against the file changing.
+// Result nodes still copy their text out of hoedown's buffers.
+static ERL_NIF_TERM parse_file(ErlNifEnv* env, greenbar::MarkdownParser* parser, const greenbar::ParserConfig& config,
+                               const char* path, bool map) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  greenbar::stats::add(greenbar::STAT_CALLS);
+  auto doc = parser->acquire();
+  if (doc == nullptr) {
+    greenbar::stats::add(greenbar::STAT_ERRORS);
+    GB_TRACE_ERROR("out_of_memory");
+    return priv_data->gb_atom_out_of_memory;
+  }
+  gb_mapping_s mapping;
+  mapping.addr = NULL;
+  mapping.size = 0;
+  int error = map ? map_file(path, config.limits.max_input_size, &mapping) :
+    read_file(path, config.limits.max_input_size, doc->input);
+  if (error == EFBIG) {
+    parser->release(doc);
+    count_limit_hit(greenbar::LIMIT_INPUT_SIZE);
+    GB_TRACE_LIMIT((int) greenbar::LIMIT_INPUT_SIZE, 0, 0);
+    return limit_error(env, greenbar::LIMIT_INPUT_SIZE, priv_data);
+  }
+  if (error != 0) {
+    parser->release(doc);
+    greenbar::stats::add(greenbar::STAT_ERRORS);
+    GB_TRACE_ERROR("file");
+    return enif_make_tuple(env, 2, priv_data->gb_atom_error, errno_to_atom(env, error));
+  }
+  gb_input_s input;
+  if (map) {
+    input.data = mapping.addr != NULL ? (const uint8_t*) mapping.addr : (const uint8_t*) "";
+    input.size = mapping.size;
+  } else {
+    input.data = doc->input->size > 0 ? doc->input->data : (const uint8_t*) "";
+    input.size = doc->input->size;
+  }
+  greenbar::memory::begin_call();
+  ERL_NIF_TERM result = parse_document(env, parser, config, doc, input, nullptr);
+  auto used = greenbar::memory::end_call();
+  greenbar::stats::record(greenbar::HIST_PEAK_KB, used.peak / 1024);
+  if (mapping.addr != NULL) {
+    munmap(mapping.addr, mapping.size);
+  }
+  return result;
+}
+
 NIF(gb_parse) {
   gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
-  ErlNifBinary input;
-  if (enif_inspect_binary(env, argv[0], &input) == 0) {
+  auto parser = priv_data->default_parser;
+  return run_parse(env, parser, parser->config(), argv[0]);
+}
+
+NIF(gb_parse_with_options) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  greenbar::ParserConfig config;
+  if (!parse_options(env, argv[1], priv_data, &config)) {
+    return enif_make_badarg(env);
+  }
+  // Limits and output settings can be applied per call so the shared pool still serves
+  if (priv_data->default_parser->same_document(config)) {
+    return run_parse(env, priv_data->default_parser, config, argv[0]);
+  }
+  if (priv_data->html_parser->same_document(config)) {
+    return run_parse(env, priv_data->html_parser, config, argv[0]);
+  }
+  config.pool_size = 0;
+  greenbar::MarkdownParser parser(config);
+  return run_parse(env, &parser, config, argv[0]);
+}
+
+// parse_file(Path, Map, Options) with Path a binary in the native file name
+// encoding and Map true to parse from a mapping
+NIF(gb_parse_file) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  ErlNifBinary name;
+  greenbar::ParserConfig config;
+  if (!enif_inspect_binary(env, argv[0], &name) || name.size == 0 ||
+      memchr(name.data, 0, name.size) != NULL || !parse_options(env, argv[2], priv_data, &config)) {
+    return enif_make_badarg(env);
+  }
+  bool map = enif_is_identical(argv[1], priv_data->gb_atom_true);
+  if (!map && !enif_is_identical(argv[1], priv_data->gb_atom_false)) {
     return enif_make_badarg(env);
   }
+  std::string path((const char*) name.data, name.size);
+  if (priv_data->default_parser->same_document(config)) {
+    return parse_file(env, priv_data->default_parser, config, path.c_str(), map);
+  }
+  if (priv_data->html_parser->same_document(config)) {
+    return parse_file(env, priv_data->html_parser, config, path.c_str(), map);
+  }
+  config.pool_size = 0;
+  greenbar::MarkdownParser parser(config);
+  return parse_file(env, &parser, config, path.c_str(), map);
+}
 
-  hoedown_buffer* ob = hoedown_buffer_new(OUTPUT_SIZE);
-  if (ob == NULL) {
+NIF(gb_new_parser) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  greenbar::ParserConfig config;
+  if (!parse_options(env, argv[0], priv_data, &config)) {
+    return enif_make_badarg(env);
+  }
+  void* mem = enif_alloc_resource(priv_data->gb_parser_type, sizeof(gb_parser_res));
+  if (mem == NULL) {
     return priv_data->gb_atom_out_of_memory;
   }
-  auto analyzer = greenbar::new_markdown_analyzer();
-  if (analyzer == NULL) {
-    hoedown_buffer_free(ob);
+  gb_parser_res* res = new (mem) gb_parser_res();
+  res->config = config;
+  res->parser.store(new_handle_parser(config), std::memory_order_relaxed);
+  res->generation.store(priv_data->generation, std::memory_order_release);
+  // Warm the pool so the first parse skips document setup
+  res->parser.load(std::memory_order_relaxed)->warm(1);
+  ERL_NIF_TERM handle = enif_make_resource(env, res);
+  enif_release_resource(res);
+  return enif_make_tuple(env, 2, priv_data->gb_atom_ok,
+                         enif_make_tuple(env, 2, priv_data->gb_atom_greenbar_parser, handle));
+}
+
+NIF(gb_parse_with_parser) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  gb_parser_res* res;
+  if (!enif_get_resource(env, argv[0], priv_data->gb_parser_type, (void**) &res)) {
+    return enif_make_badarg(env);
+  }
+  auto parser = handle_parser(res, priv_data);
+  return run_parse(env, parser, parser->config(), argv[1]);
+}
+
+// Sends top-level nodes to a process as the analyzer finishes them
+typedef struct {
+  ErlNifEnv* env;
+  // Holds one message at a time
+  ErlNifEnv* msg_env;
+  ErlNifPid pid;
+  ERL_NIF_TERM ref;
+  ERL_NIF_TERM tag;
+  greenbar::TermContext ctx;
+  greenbar::StringTable* strings;
+  // Cleared once the receiver is gone or a limit trips
+  bool sending;
+  greenbar::node2::NodeType last_type;
+} gb_stream_s;
+
+static void send_node(gb_stream_s* stream, greenbar::node2::MarkdownNode* node) {
+  stream->last_type = node->get_type();
+  if (!stream->sending || !stream->ctx.limits->tick()) {
+    stream->sending = false;
+    return;
+  }
+  ERL_NIF_TERM msg = enif_make_tuple(stream->msg_env, 3, stream->tag, enif_make_copy(stream->msg_env, stream->ref),
+                                     greenbar::node_to_term(stream->ctx, node));
+  stream->sending = enif_send(stream->env, &stream->pid, stream->msg_env, msg);
+  // Shared text can't outlive the message it was made for
+  enif_clear_env(stream->msg_env);
+  if (stream->strings != nullptr) {
+    stream->strings->clear();
+  }
+}
+
+static void stream_block(void* opaque, greenbar::node2::MarkdownNode* node) {
+  send_node((gb_stream_s*) opaque, node);
+  delete node;
+}
+
+// Like parse_input but hands nodes to the stream instead of building a
+// list. Returns what the done message carries.
+static ERL_NIF_TERM stream_input(ErlNifEnv* env, greenbar::MarkdownParser* parser, const greenbar::ParserConfig& config,
+                                 ERL_NIF_TERM text, gb_stream_s* stream) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  const greenbar::ParseLimits& limits = config.limits;
+  greenbar::stats::add(greenbar::STAT_CALLS);
+  auto doc = parser->acquire();
+  if (doc == nullptr) {
+    greenbar::stats::add(greenbar::STAT_ERRORS);
+    GB_TRACE_ERROR("out_of_memory");
     return priv_data->gb_atom_out_of_memory;
   }
-  hoedown_document* document = greenbar::new_hoedown_document(analyzer);
-  if (document == NULL) {
-    greenbar::free_markdown_analyzer(analyzer);
-    hoedown_buffer_free(ob);
+  gb_input_s input;
+  if (!get_input(env, text, doc->input, &input)) {
+    parser->release(doc);
+    greenbar::stats::add(greenbar::STAT_ERRORS);
+    GB_TRACE_ERROR("badarg");
+    return enif_make_badarg(env);
+  }
+  greenbar::stats::add(greenbar::STAT_INPUT_BYTES, input.size);
+  GB_TRACE_PARSE_START(input.size);
+  if (limits.max_input_size > 0 && input.size > limits.max_input_size) {
+    parser->release(doc);
+    count_limit_hit(greenbar::LIMIT_INPUT_SIZE);
+    GB_TRACE_LIMIT((int) greenbar::LIMIT_INPUT_SIZE, input.size, 0);
+    return limit_error(env, greenbar::LIMIT_INPUT_SIZE, priv_data);
+  }
+  auto tracker = greenbar::get_limits(doc->analyzer);
+  stream->ctx.limits = tracker;
+  auto started = std::chrono::steady_clock::now();
+  greenbar::set_block_sink(doc->analyzer, doc->ob, stream_block, stream);
+  parser->render(doc, input.data, input.size, limits);
+  greenbar::set_block_sink(doc->analyzer, nullptr, nullptr, nullptr);
+  // The rest of the collector is final now, sent with the same end of
+  // template trimming as convert_results
+  auto collector = greenbar::get_collector(doc->analyzer);
+  for (size_t i = 0; i < collector->size() && !tracker->exceeded(); i++) {
+    auto node = collector->at(i);
+    auto previous = i > 0 ? collector->at(i - 1)->get_type() : stream->last_type;
+    if (i == collector->size() - 1 && node->get_type() == greenbar::node2::MD_EOL &&
+        previous == greenbar::node2::MD_EOL) {
+      break;
+    }
+    send_node(stream, node);
+  }
+  uint64_t duration_us = elapsed_us(started);
+  greenbar::stats::record(greenbar::HIST_PARSE_US, duration_us);
+  ERL_NIF_TERM result;
+  if (tracker->exceeded()) {
+    count_limit_hit(tracker->which());
+    GB_TRACE_LIMIT((int) tracker->which(), input.size, tracker->node_count());
+    result = limit_error(env, tracker->which(), priv_data);
+  } else {
+    GB_TRACE_PARSE_DONE(input.size, tracker->node_count(), duration_us);
+    result = priv_data->gb_atom_ok;
+  }
+  // Rendering and converting interleave, so both count as render time
+  greenbar::slowlog::record(input.data, input.size, duration_us, duration_us, tracker->node_count(),
+                            tracker->exceeded() ? tracker->which() : greenbar::LIMIT_NONE);
+  parser->release(doc);
+  return result;
+}
+
+// stream(Text, Options, Pid, Ref) sends {greenbar_block, Ref, Node} for each
+// top-level node in document order, then {greenbar_done, Ref, Result} where
+// Result is also returned. Pid can't be the caller, which is busy in this
+// call until the parse is done.
+NIF(gb_stream) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  greenbar::ParserConfig config;
+  gb_stream_s stream;
+  if (!parse_options(env, argv[1], priv_data, &config) || config.output != greenbar::OUTPUT_TREE ||
+      !enif_get_local_pid(env, argv[2], &stream.pid) || !enif_is_ref(env, argv[3])) {
+    return enif_make_badarg(env);
+  }
+  ErlNifPid caller;
+  if (enif_self(env, &caller) != NULL && enif_compare(enif_make_pid(env, &caller), argv[2]) == 0) {
+    return enif_make_badarg(env);
+  }
+  stream.env = env;
+  stream.msg_env = enif_alloc_env();
+  if (stream.msg_env == NULL) {
     return priv_data->gb_atom_out_of_memory;
   }
-  hoedown_document_render(document, ob, (uint8_t*) input.data, input.size);
+  greenbar::StringTable strings;
+  stream.ref = argv[3];
+  stream.tag = make_atom(env, "greenbar_block");
+  stream.strings = config.intern_strings ? &strings : nullptr;
+  stream.sending = true;
+  stream.last_type = greenbar::node2::MD_NONE;
+  stream.ctx.env = stream.msg_env;
+  stream.ctx.priv_data = priv_data;
+  stream.ctx.limits = nullptr;
+  stream.ctx.tables = config.tables;
+  stream.ctx.table_batch_size = config.table_batch_size;
+  stream.ctx.profile = nullptr;
+  stream.ctx.strings = stream.strings;
+  stream.ctx.page_bytes = config.page_bytes;
 
-  enif_release_binary(&input);
-  auto collector = greenbar::get_collector(analyzer);
-  auto result = convert_results(env, collector);
-  greenbar::free_markdown_analyzer(analyzer);
-  hoedown_document_free(document);
-  return enif_make_tuple(env, 2, priv_data->gb_atom_ok, result);
+  greenbar::memory::begin_call();
+  ERL_NIF_TERM result;
+  if (priv_data->default_parser->same_document(config)) {
+    result = stream_input(env, priv_data->default_parser, config, argv[0], &stream);
+  } else {
+    config.pool_size = 0;
+    greenbar::MarkdownParser parser(config);
+    result = stream_input(env, &parser, config, argv[0], &stream);
+  }
+  auto used = greenbar::memory::end_call();
+  greenbar::stats::record(greenbar::HIST_PEAK_KB, used.peak / 1024);
+
+  if (!enif_is_exception(env, result)) {
+    ERL_NIF_TERM done = enif_make_tuple(stream.msg_env, 3, make_atom(env, "greenbar_done"),
+                                        enif_make_copy(stream.msg_env, stream.ref),
+                                        enif_make_copy(stream.msg_env, result));
+    enif_send(env, &stream.pid, stream.msg_env, done);
+  }
+  enif_free_env(stream.msg_env);
+  return result;
+}
+
+static std::atomic<uint32_t> ring_counter(0);
+
+// ring_new(RingBytes) makes the shared memory of a greenbar_markdown_worker
+// and returns {ok, Ring, Name}, Name being what gb_worker attaches to
+NIF(gb_ring_new) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  unsigned long ring_bytes;
+  // Record sizes are 32 bits
+  if (!enif_get_ulong(env, argv[0], &ring_bytes) || ring_bytes > UINT32_MAX) {
+    return enif_make_badarg(env);
+  }
+  void* mem = enif_alloc_resource(priv_data->gb_ring_type, sizeof(gb_ring_res));
+  if (mem == NULL) {
+    return priv_data->gb_atom_out_of_memory;
+  }
+  auto res = new (mem) gb_ring_res();
+  int error = EEXIST;
+  for (int i = 0; i < GB_RING_NAME_TRIES && error == EEXIST; i++) {
+    snprintf(res->name, sizeof(res->name), "/greenbar-%d-%u", (int) getpid(),
+             ring_counter.fetch_add(1, std::memory_order_relaxed));
+    error = greenbar::ring::create(res->name, ring_bytes, &res->segment);
+  }
+  if (error != 0) {
+    res->name[0] = '\0';
+    enif_release_resource(res);
+    return enif_make_tuple(env, 2, priv_data->gb_atom_error, errno_to_atom(env, error));
+  }
+  ERL_NIF_TERM ring = enif_make_resource(env, res);
+  enif_release_resource(res);
+  ERL_NIF_TERM name;
+  size_t name_size = strlen(res->name);
+  // The ring is unmapped and its name unlinked once the handle is collected
+  unsigned char* out = enif_make_new_binary(env, name_size, &name);
+  if (out == NULL) {
+    return priv_data->gb_atom_out_of_memory;
+  }
+  memcpy(out, res->name, name_size);
+  return enif_make_tuple(env, 3, priv_data->gb_atom_ok, ring, name);
+}
+
+// ring_submit(Ring, Id, Text) copies Text into the request ring. Returns
+// full until the worker has made room.
+NIF(gb_ring_submit) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  gb_ring_res* res;
+  ErlNifUInt64 id;
+  ErlNifBinary text;
+  if (!enif_get_resource(env, argv[0], priv_data->gb_ring_type, (void**) &res) ||
+      !enif_get_uint64(env, argv[1], &id) || !enif_inspect_iolist_as_binary(env, argv[2], &text)) {
+    return enif_make_badarg(env);
+  }
+  std::lock_guard<std::mutex> guard(res->lock);
+  greenbar::SharedRing& requests = res->segment.requests;
+  if (text.size > requests.max_payload()) {
+    return limit_error(env, greenbar::LIMIT_INPUT_SIZE, priv_data);
+  }
+  uint8_t* payload = requests.reserve(text.size);
+  if (payload == nullptr) {
+    return make_atom(env, "full");
+  }
+  memcpy(payload, text.data, text.size);
+  requests.commit(text.size, id);
+  return priv_data->gb_atom_ok;
+}
+
+// ring_take(Ring) returns the oldest result as {Id, Term} with Term in
+// external term format, or empty
+NIF(gb_ring_take) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  gb_ring_res* res;
+  if (!enif_get_resource(env, argv[0], priv_data->gb_ring_type, (void**) &res)) {
+    return enif_make_badarg(env);
+  }
+  std::lock_guard<std::mutex> guard(res->lock);
+  greenbar::RingRecord record;
+  const uint8_t* payload;
+  if (!res->segment.responses.peek(&record, &payload)) {
+    return make_atom(env, "empty");
+  }
+  ERL_NIF_TERM result;
+  unsigned char* out = enif_make_new_binary(env, record.size, &result);
+  // The record stays for the next attempt
+  if (out == NULL) {
+    return priv_data->gb_atom_out_of_memory;
+  }
+  memcpy(out, payload, record.size);
+  res->segment.responses.release();
+  return enif_make_tuple(env, 2, enif_make_uint64(env, record.id), result);
+}
+
+// Histogram as [{UpperBoundUs, Count}], the open last bucket bounded by infinity
+static ERL_NIF_TERM histogram_to_term(ErlNifEnv* env, const uint64_t* buckets, gb_priv_s* priv_data) {
+  ERL_NIF_TERM tail = enif_make_list(env, 0);
+  for (size_t i = GB_HISTOGRAM_BUCKETS; i > 0; i--) {
+    uint64_t limit = greenbar::stats::bucket_limit(i - 1);
+    ERL_NIF_TERM bound = limit == 0 ? priv_data->gb_atom_infinity : enif_make_uint64(env, limit);
+    ERL_NIF_TERM bucket = enif_make_tuple(env, 2, bound, enif_make_uint64(env, buckets[i - 1]));
+    tail = enif_make_list_cell(env, bucket, tail);
+  }
+  return tail;
+}
 
+static ERL_NIF_TERM memory_to_term(ErlNifEnv* env) {
+  auto totals = greenbar::memory::totals();
+  ERL_NIF_TERM result = enif_make_new_map(env);
+  enif_make_map_put(env, result, make_atom(env, "current"), enif_make_int64(env, totals.current), &result);
+  enif_make_map_put(env, result, make_atom(env, "peak"), enif_make_int64(env, totals.peak), &result);
+  enif_make_map_put(env, result, make_atom(env, "allocated"), enif_make_uint64(env, totals.allocated), &result);
+  enif_make_map_put(env, result, make_atom(env, "allocations"), enif_make_uint64(env, totals.allocations), &result);
+  enif_make_map_put(env, result, make_atom(env, "largest_call_peak"),
+                    enif_make_uint64(env, totals.largest_call_peak), &result);
+  return result;
+}
+
+// Node types which can appear in results
+static const greenbar::node2::NodeType result_types[] = {
+  greenbar::node2::MD_PARAGRAPH, greenbar::node2::MD_EOL, greenbar::node2::MD_TEXT,
+  greenbar::node2::MD_FIXED_WIDTH, greenbar::node2::MD_FIXED_WIDTH_BLOCK, greenbar::node2::MD_HEADER,
+  greenbar::node2::MD_ITALICS, greenbar::node2::MD_BOLD, greenbar::node2::MD_STRIKETHROUGH,
+  greenbar::node2::MD_LINK, greenbar::node2::MD_LIST_ITEM, greenbar::node2::MD_ORDERED_LIST,
+  greenbar::node2::MD_UNORDERED_LIST, greenbar::node2::MD_TABLE_CELL, greenbar::node2::MD_TABLE_ROW,
+  greenbar::node2::MD_TABLE_HEADER, greenbar::node2::MD_TABLE
+};
+
+// Cumulative counters summed across all scheduler threads
+NIF(gb_stats) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  greenbar::StatsSnapshot snap;
+  greenbar::stats::snapshot(&snap);
+
+  ERL_NIF_TERM nodes = enif_make_new_map(env);
+  for (auto type : result_types) {
+    enif_make_map_put(env, nodes, greenbar::type_to_atom(type, priv_data),
+                      enif_make_uint64(env, snap.nodes[type - greenbar::node2::MD_NONE]), &nodes);
+  }
+  ERL_NIF_TERM limits = enif_make_new_map(env);
+  enif_make_map_put(env, limits, priv_data->gb_atom_input_size,
+                    enif_make_uint64(env, snap.counters[greenbar::STAT_LIMIT_INPUT_SIZE]), &limits);
+  enif_make_map_put(env, limits, priv_data->gb_atom_nodes,
+                    enif_make_uint64(env, snap.counters[greenbar::STAT_LIMIT_NODES]), &limits);
+  enif_make_map_put(env, limits, priv_data->gb_atom_nesting,
+                    enif_make_uint64(env, snap.counters[greenbar::STAT_LIMIT_NESTING]), &limits);
+  enif_make_map_put(env, limits, priv_data->gb_atom_timeout,
+                    enif_make_uint64(env, snap.counters[greenbar::STAT_LIMIT_TIMEOUT]), &limits);
+  ERL_NIF_TERM pool = enif_make_new_map(env);
+  enif_make_map_put(env, pool, priv_data->gb_atom_hits,
+                    enif_make_uint64(env, snap.counters[greenbar::STAT_POOL_HITS]), &pool);
+  enif_make_map_put(env, pool, priv_data->gb_atom_misses,
+                    enif_make_uint64(env, snap.counters[greenbar::STAT_POOL_MISSES]), &pool);
+
+  ERL_NIF_TERM result = enif_make_new_map(env);
+  enif_make_map_put(env, result, priv_data->gb_atom_calls,
+                    enif_make_uint64(env, snap.counters[greenbar::STAT_CALLS]), &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_input_bytes,
+                    enif_make_uint64(env, snap.counters[greenbar::STAT_INPUT_BYTES]), &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_errors,
+                    enif_make_uint64(env, snap.counters[greenbar::STAT_ERRORS]), &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_nodes, nodes, &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_limits, limits, &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_pool, pool, &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_parse_us,
+                    histogram_to_term(env, snap.histograms[greenbar::HIST_PARSE_US], priv_data), &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_convert_us,
+                    histogram_to_term(env, snap.histograms[greenbar::HIST_CONVERT_US], priv_data), &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_peak_kb,
+                    histogram_to_term(env, snap.histograms[greenbar::HIST_PEAK_KB], priv_data), &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_memory, memory_to_term(env), &result);
+  return result;
+}
+
+static ERL_NIF_TERM profile_to_term(ErlNifEnv* env, const greenbar::ParseProfile& profile, gb_priv_s* priv_data) {
+  ERL_NIF_TERM callbacks = enif_make_new_map(env);
+  for (size_t i = 0; i < greenbar::CB_COUNT; i++) {
+    enif_make_map_put(env, callbacks, make_atom(env, greenbar::callback_name((greenbar::ProfileCallback) i)),
+                      enif_make_uint64(env, profile.callbacks[i]), &callbacks);
+  }
+  ERL_NIF_TERM nodes = enif_make_new_map(env);
+  for (auto type : result_types) {
+    uint64_t count = profile.nodes[type - greenbar::node2::MD_NONE];
+    if (count > 0) {
+      enif_make_map_put(env, nodes, greenbar::type_to_atom(type, priv_data), enif_make_uint64(env, count), &nodes);
+    }
+  }
+  ERL_NIF_TERM result = enif_make_new_map(env);
+  enif_make_map_put(env, result, make_atom(env, "render_us"), enif_make_uint64(env, profile.render_us), &result);
+  enif_make_map_put(env, result, make_atom(env, "convert_us"), enif_make_uint64(env, profile.convert_us), &result);
+  enif_make_map_put(env, result, make_atom(env, "callbacks"), callbacks, &result);
+  enif_make_map_put(env, result, make_atom(env, "fast_tables"), enif_make_uint64(env, profile.fast_tables), &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_nodes, nodes, &result);
+  enif_make_map_put(env, result, make_atom(env, "max_depth"), enif_make_uint64(env, profile.max_depth), &result);
+  enif_make_map_put(env, result, make_atom(env, "max_collector"), enif_make_uint64(env, profile.max_collector), &result);
+  enif_make_map_put(env, result, make_atom(env, "allocations"), enif_make_uint64(env, profile.allocations), &result);
+  enif_make_map_put(env, result, make_atom(env, "bytes_allocated"),
+                    enif_make_uint64(env, profile.bytes_allocated), &result);
+  enif_make_map_put(env, result, make_atom(env, "peak_bytes"), enif_make_uint64(env, profile.peak_bytes), &result);
+  return result;
+}
+
+// Parse with the default parser and also return where the work went.
+// Profiles are for diagnosis so their atoms are made on demand.
+NIF(gb_profile) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  auto parser = priv_data->default_parser;
+  greenbar::ParseProfile profile;
+  ERL_NIF_TERM result = run_parse(env, parser, parser->config(), argv[0], &profile);
+  int arity;
+  const ERL_NIF_TERM* parts;
+  if (!enif_get_tuple(env, result, &arity, &parts) || arity != 2) {
+    return result;
+  }
+  return enif_make_tuple(env, 3, parts[0], parts[1], profile_to_term(env, profile, priv_data));
+}
+
+static ERL_NIF_TERM slow_parse_to_term(ErlNifEnv* env, const greenbar::SlowParse& entry, gb_priv_s* priv_data) {
+  ERL_NIF_TERM result = enif_make_new_map(env);
+  ERL_NIF_TERM limit = entry.limit == greenbar::LIMIT_NONE ? priv_data->gb_atom_none
+    : limit_to_atom(entry.limit, priv_data);
+  enif_make_map_put(env, result, make_atom(env, "duration_us"), enif_make_uint64(env, entry.duration_us), &result);
+  enif_make_map_put(env, result, make_atom(env, "render_us"), enif_make_uint64(env, entry.render_us), &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_input_bytes, enif_make_uint64(env, entry.bytes), &result);
+  enif_make_map_put(env, result, priv_data->gb_atom_nodes, enif_make_uint64(env, entry.nodes), &result);
+  enif_make_map_put(env, result, make_atom(env, "limit"), limit, &result);
+  enif_make_map_put(env, result, make_atom(env, "hash"), enif_make_uint64(env, entry.hash), &result);
+  enif_make_map_put(env, result, make_atom(env, "at_ms"), enif_make_int64(env, entry.at_ms), &result);
+  if (!entry.sample.empty()) {
+    ERL_NIF_TERM sample;
+    auto data = enif_make_new_binary(env, entry.sample.size(), &sample);
+    // The entry is still worth reporting without its sample
+    if (data != NULL) {
+      memcpy(data, entry.sample.data(), entry.sample.size());
+      enif_make_map_put(env, result, make_atom(env, "sample"), sample, &result);
+    }
+  }
+  return result;
+}
+
+// Recent slow parses, slowest first. Like profiles, their atoms are made on demand.
+NIF(gb_slow_parses) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  std::vector<greenbar::SlowParse> entries;
+  greenbar::slowlog::entries(&entries);
+  ERL_NIF_TERM tail = enif_make_list(env, 0);
+  for (auto iter = entries.rbegin(); iter != entries.rend(); ++iter) {
+    tail = enif_make_list_cell(env, slow_parse_to_term(env, *iter, priv_data), tail);
+  }
+  return tail;
+}
+
+// Options not given keep their current values. Clears the log.
+NIF(gb_configure_slow_parses) {
+  gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
+  greenbar::SlowLogConfig config = greenbar::slowlog::config();
+  ERL_NIF_TERM head, tail = argv[0];
+  ERL_NIF_TERM threshold_us = make_atom(env, "threshold_us");
+  ERL_NIF_TERM capacity = make_atom(env, "capacity");
+  ERL_NIF_TERM sample_bytes = make_atom(env, "sample_bytes");
+  while (enif_get_list_cell(env, tail, &head, &tail)) {
+    int arity;
+    const ERL_NIF_TERM* option;
+    unsigned long value;
+    if (!enif_get_tuple(env, head, &arity, &option) || arity != 2 || !enif_get_ulong(env, option[1], &value)) {
+      return enif_make_badarg(env);
+    }
+    if (enif_is_identical(option[0], threshold_us)) {
+      config.threshold_us = value;
+    } else if (enif_is_identical(option[0], capacity)) {
+      config.capacity = value;
+    } else if (enif_is_identical(option[0], sample_bytes)) {
+      config.sample_bytes = value;
+    } else {
+      return enif_make_badarg(env);
+    }
+  }
+  if (!enif_is_list(env, tail)) {
+    return enif_make_badarg(env);
+  }
+  greenbar::slowlog::configure(config);
+  return priv_data->gb_atom_ok;
 }
 
 ERL_NIF_INIT(greenbar_markdown, nif_funcs, on_load, NULL, on_upgrade, on_unload)
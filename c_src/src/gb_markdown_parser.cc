@@ -0,0 +1,266 @@
+#include <strings.h>
+#include <chrono>
+#include <cstring>
+
+#include "gb_normalize.hpp"
+#include "gb_stats.hpp"
+#include "markdown_parser.hpp"
+
+// Preferred write size for hoedown's output buffer
+#define OUTPUT_SIZE 128
+
+// Growth unit of the input scratch buffer
+#define INPUT_UNIT 4096
+
+// Scratch and output buffers larger than this are released instead of pooled
+#define MAX_IDLE_INPUT (1024 * 1024)
+
+namespace greenbar {
+
+  static const struct {
+    const char* name;
+    unsigned int flag;
+  } extension_names[] = {
+    {"tables", HOEDOWN_EXT_TABLES},
+    {"fenced_code", HOEDOWN_EXT_FENCED_CODE},
+    {"autolink", HOEDOWN_EXT_AUTOLINK},
+    {"strikethrough", HOEDOWN_EXT_STRIKETHROUGH},
+    {"no_intra_emphasis", HOEDOWN_EXT_NO_INTRA_EMPHASIS},
+    {"space_headers", HOEDOWN_EXT_SPACE_HEADERS},
+    {"math_explicit", HOEDOWN_EXT_MATH_EXPLICIT},
+    {"disable_indented_code", HOEDOWN_EXT_DISABLE_INDENTED_CODE},
+    {nullptr, 0}
+  };
+
+  // Schemes an HTML preview may link to. Relative links have no scheme.
+  static const char* safe_schemes[] = {"http", "https", "ftp", "mailto", nullptr};
+
+  // hoedown's own link callback, wrapped by safe_link
+  static int (*html_link)(hoedown_buffer* ob, const hoedown_buffer* content, const hoedown_buffer* link,
+                          const hoedown_buffer* title, const hoedown_renderer_data* data);
+  static std::once_flag html_link_once;
+
+  static bool safe_url(const hoedown_buffer* url) {
+    size_t end = 0;
+    while (end < url->size && strchr(":/?#", url->data[end]) == nullptr) {
+      end++;
+    }
+    if (end == url->size || url->data[end] != ':') {
+      return true;
+    }
+    // Browsers skip whitespace and control characters inside a scheme, so
+    // only an exact match counts
+    for (int i = 0; safe_schemes[i] != nullptr; i++) {
+      if (strlen(safe_schemes[i]) == end && strncasecmp(safe_schemes[i], (const char*) url->data, end) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // hoedown 3 dropped HOEDOWN_HTML_SAFELINK. Links to other schemes, such as
+  // javascript:, are left as escaped text instead.
+  static int safe_link(hoedown_buffer* ob, const hoedown_buffer* content, const hoedown_buffer* link,
+                       const hoedown_buffer* title, const hoedown_renderer_data* data) {
+    if (link != nullptr && !safe_url(link)) {
+      return 0;
+    }
+    return html_link(ob, content, link, title, data);
+  }
+
+  bool extension_flag(const char* name, unsigned int* flag) {
+    for (int i = 0; extension_names[i].name != nullptr; i++) {
+      if (strcmp(extension_names[i].name, name) == 0) {
+        *flag = extension_names[i].flag;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  MarkdownParser::MarkdownParser(const ParserConfig& config) : config_(config) { }
+
+  MarkdownParser::~MarkdownParser() {
+    while (!idle_.empty()) {
+      free_document(idle_.back());
+      idle_.pop_back();
+    }
+  }
+
+  PooledDocument* MarkdownParser::new_document() {
+    auto doc = (PooledDocument*) memory::allocate(sizeof(PooledDocument));
+    if (doc == nullptr) {
+      return nullptr;
+    }
+    doc->ob = hoedown_buffer_new(OUTPUT_SIZE);
+    doc->input = hoedown_buffer_new(INPUT_UNIT);
+    doc->normalized = config_.normalize_whitespace ? hoedown_buffer_new(INPUT_UNIT) : nullptr;
+    doc->analyzer = nullptr;
+    doc->html = nullptr;
+    doc->document = nullptr;
+    if (config_.output == OUTPUT_HTML) {
+      // Previews show chat and user text, so raw HTML is escaped
+      doc->html = hoedown_html_renderer_new(HOEDOWN_HTML_ESCAPE, 0);
+      if (doc->html != nullptr) {
+        std::call_once(html_link_once, [&]() { html_link = doc->html->link; });
+        doc->html->link = safe_link;
+        doc->document = new_hoedown_document(doc->html, config_.extensions, config_.limits.max_nesting);
+      }
+    } else {
+      doc->analyzer = new_markdown_analyzer();
+      if (doc->analyzer != nullptr) {
+        doc->document = new_hoedown_document(doc->analyzer, config_.extensions, config_.limits.max_nesting);
+      }
+    }
+    if (doc->ob == nullptr || doc->input == nullptr || doc->document == nullptr ||
+        (config_.normalize_whitespace && doc->normalized == nullptr)) {
+      free_document(doc);
+      return nullptr;
+    }
+    return doc;
+  }
+
+  void MarkdownParser::free_document(PooledDocument* doc) {
+    if (doc->document != nullptr) {
+      hoedown_document_free(doc->document);
+    }
+    if (doc->analyzer != nullptr) {
+      free_markdown_analyzer(doc->analyzer);
+    }
+    if (doc->html != nullptr) {
+      hoedown_html_renderer_free(doc->html);
+    }
+    if (doc->ob != nullptr) {
+      hoedown_buffer_free(doc->ob);
+    }
+    if (doc->input != nullptr) {
+      hoedown_buffer_free(doc->input);
+    }
+    if (doc->normalized != nullptr) {
+      hoedown_buffer_free(doc->normalized);
+    }
+    memory::release(doc);
+  }
+
+  bool MarkdownParser::same_document(const ParserConfig& other) {
+    return config_.extensions == other.extensions &&
+      config_.limits.max_nesting == other.limits.max_nesting &&
+      config_.normalize_whitespace == other.normalize_whitespace &&
+      (config_.output == OUTPUT_HTML) == (other.output == OUTPUT_HTML);
+  }
+
+  PooledDocument* MarkdownParser::acquire() {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      if (!idle_.empty()) {
+        auto doc = idle_.back();
+        idle_.pop_back();
+        stats::add(STAT_POOL_HITS);
+        return doc;
+      }
+    }
+    stats::add(STAT_POOL_MISSES);
+    return new_document();
+  }
+
+  void MarkdownParser::release(PooledDocument* doc) {
+    if (doc->analyzer != nullptr) {
+      clear_collector(doc->analyzer);
+    }
+    // Keep the buffers' allocations for the next render
+    if (doc->ob->asize > MAX_IDLE_INPUT) {
+      hoedown_buffer_reset(doc->ob);
+    }
+    doc->ob->size = 0;
+    if (doc->input->asize > MAX_IDLE_INPUT) {
+      hoedown_buffer_reset(doc->input);
+    }
+    doc->input->size = 0;
+    if (doc->normalized != nullptr) {
+      if (doc->normalized->asize > MAX_IDLE_INPUT) {
+        hoedown_buffer_reset(doc->normalized);
+      }
+      doc->normalized->size = 0;
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      if (idle_.size() < config_.pool_size) {
+        idle_.push_back(doc);
+        return;
+      }
+    }
+    free_document(doc);
+  }
+
+  size_t MarkdownParser::idle() {
+    std::lock_guard<std::mutex> guard(lock_);
+    return idle_.size();
+  }
+
+  size_t MarkdownParser::warm(size_t count) {
+    if (count > config_.pool_size) {
+      count = config_.pool_size;
+    }
+    size_t ready = idle();
+    // Documents are built outside the lock so parses aren't held up
+    while (ready < count) {
+      auto doc = new_document();
+      if (doc == nullptr) {
+        break;
+      }
+      std::lock_guard<std::mutex> guard(lock_);
+      if (idle_.size() >= count) {
+        free_document(doc);
+        break;
+      }
+      idle_.push_back(doc);
+      ready = idle_.size();
+    }
+    return idle();
+  }
+
+  void MarkdownParser::render(PooledDocument* doc, const uint8_t* data, size_t size, const ParseLimits& limits,
+                              ParseProfile* profile) {
+    if (profile != nullptr) {
+      auto started = std::chrono::steady_clock::now();
+      set_profile(doc->analyzer, profile);
+      profile::track_allocations(profile);
+      render(doc, data, size, limits);
+      profile::track_allocations(nullptr);
+      set_profile(doc->analyzer, nullptr);
+      profile->render_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+      return;
+    }
+    if (config_.normalize_whitespace && normalize_whitespace(data, size, doc->normalized)) {
+      data = doc->normalized->data;
+      size = doc->normalized->size;
+    }
+    if (doc->analyzer == nullptr) {
+      hoedown_document_render(doc->document, doc->ob, data, size);
+      return;
+    }
+    get_limits(doc->analyzer)->reset(limits);
+    // Large plain pipe tables are built directly and hoedown renders the
+    // text between them. Every table starts a new block so the pieces
+    // render the same as the whole document would.
+    PipeTableScanner scanner(data, size, config_.extensions, GB_FAST_TABLE_MIN_ROWS);
+    PipeTable table;
+    size_t rendered = 0;
+    while (scanner.next(&table)) {
+      if (table.start > rendered) {
+        hoedown_document_render(doc->document, doc->ob, data + rendered, table.start - rendered);
+        rendered = table.start;
+      }
+      // Otherwise hoedown renders the table along with the next piece
+      if (accepts_table(doc->analyzer)) {
+        build_table(doc->analyzer, data, table);
+        rendered = table.end;
+      }
+    }
+    if (rendered < size) {
+      hoedown_document_render(doc->document, doc->ob, data + rendered, size - rendered);
+    }
+  }
+
+}
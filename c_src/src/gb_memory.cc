@@ -0,0 +1,241 @@
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include "gb_memory.hpp"
+#include "parse_profile.hpp"
+
+// Unpublished bytes a thread may hold before updating the totals
+#define GB_MEMORY_FLUSH (64 * 1024)
+
+// Keeps the payload aligned as the backing allocator returned it
+#define HEADER_SIZE 16
+
+// Per-thread buffer for the node allocations of small parses
+#define GB_ARENA_SIZE (16 * 1024)
+
+extern "C" {
+  // hoedown's malloc family is renamed to these when the build supports it
+  void* gb_malloc(size_t size);
+  void* gb_calloc(size_t count, size_t size);
+  void* gb_realloc(void* ptr, size_t size);
+  void gb_free(void* ptr);
+}
+
+namespace greenbar {
+  namespace memory {
+
+    struct BlockHeader {
+      size_t size;
+      const Allocator* owner;
+    };
+
+    static_assert(sizeof(BlockHeader) <= HEADER_SIZE, "allocation header too large");
+
+    static const Allocator system_allocator = {std::malloc, std::realloc, std::free};
+
+    static std::atomic<const Allocator*> installed(&system_allocator);
+
+    static std::atomic<int64_t> total_current(0);
+    static std::atomic<int64_t> total_peak(0);
+    static std::atomic<uint64_t> total_allocated(0);
+    static std::atomic<uint64_t> total_allocations(0);
+    static std::atomic<uint64_t> largest_call_peak(0);
+
+    // Counts not yet added to the totals, and the running call
+    struct ThreadMemory {
+      int64_t pending;
+      uint64_t pending_allocated;
+      uint64_t pending_allocations;
+      bool in_call;
+      CallMemory call;
+    };
+
+    static thread_local ThreadMemory local = {0, 0, 0, false, {0, 0, 0}};
+
+    // Owner recorded in arena block headers, never called
+    static const Allocator arena_owner = {nullptr, nullptr, nullptr};
+
+    struct Arena {
+      alignas(HEADER_SIZE) char buffer[GB_ARENA_SIZE];
+      size_t used;
+      bool active;
+    };
+
+    static thread_local Arena arena;
+
+    static void raise_to(std::atomic<int64_t>& target, int64_t value) {
+      int64_t seen = target.load(std::memory_order_relaxed);
+      while (value > seen && !target.compare_exchange_weak(seen, value, std::memory_order_relaxed)) { }
+    }
+
+    static void flush() {
+      int64_t current = total_current.fetch_add(local.pending, std::memory_order_relaxed) + local.pending;
+      raise_to(total_peak, current);
+      total_allocated.fetch_add(local.pending_allocated, std::memory_order_relaxed);
+      total_allocations.fetch_add(local.pending_allocations, std::memory_order_relaxed);
+      local.pending = 0;
+      local.pending_allocated = 0;
+      local.pending_allocations = 0;
+    }
+
+    static void count(int64_t delta) {
+      local.pending += delta;
+      if (delta > 0) {
+        local.pending_allocated += delta;
+        local.pending_allocations++;
+        profile::count_allocation(delta);
+      }
+      if (local.in_call) {
+        local.call.current += delta;
+        if (delta > 0) {
+          local.call.allocated += delta;
+        }
+        if (local.call.current > local.call.peak) {
+          local.call.peak = local.call.current;
+        }
+      }
+      if (local.pending > GB_MEMORY_FLUSH || local.pending < -GB_MEMORY_FLUSH) {
+        flush();
+      }
+    }
+
+    static inline BlockHeader* header_of(void* ptr) {
+      return (BlockHeader*) ((char*) ptr - HEADER_SIZE);
+    }
+
+    void set_allocator(const Allocator* allocator) {
+      installed.store(allocator == nullptr ? &system_allocator : allocator);
+    }
+
+    void* allocate(size_t size) {
+      if (size > SIZE_MAX - HEADER_SIZE) {
+        return nullptr;
+      }
+      auto owner = installed.load(std::memory_order_acquire);
+      auto header = (BlockHeader*) owner->alloc(size + HEADER_SIZE);
+      if (header == nullptr) {
+        return nullptr;
+      }
+      header->size = size;
+      header->owner = owner;
+      count(size);
+      return (char*) header + HEADER_SIZE;
+    }
+
+    void* reallocate(void* ptr, size_t size) {
+      if (ptr == nullptr) {
+        return allocate(size);
+      }
+      if (size > SIZE_MAX - HEADER_SIZE) {
+        return nullptr;
+      }
+      auto header = header_of(ptr);
+      size_t old_size = header->size;
+      auto owner = header->owner;
+      if (owner == &arena_owner) {
+        void* moved = allocate_node(size);
+        if (moved != nullptr) {
+          memcpy(moved, ptr, old_size < size ? old_size : size);
+        }
+        return moved;
+      }
+      header = (BlockHeader*) owner->realloc(header, size + HEADER_SIZE);
+      if (header == nullptr) {
+        return nullptr;
+      }
+      header->size = size;
+      count((int64_t) size - (int64_t) old_size);
+      return (char*) header + HEADER_SIZE;
+    }
+
+    void release(void* ptr) {
+      if (ptr == nullptr) {
+        return;
+      }
+      auto header = header_of(ptr);
+      if (header->owner == &arena_owner) {
+        return;
+      }
+      count(-(int64_t) header->size);
+      header->owner->free(header);
+    }
+
+    void begin_arena() {
+      arena.used = 0;
+      arena.active = true;
+    }
+
+    void end_arena() {
+      arena.active = false;
+      arena.used = 0;
+    }
+
+    void* allocate_node(size_t size) {
+      if (arena.active && size <= GB_ARENA_SIZE) {
+        // Round up so the next header stays aligned
+        size_t needed = HEADER_SIZE + ((size + HEADER_SIZE - 1) & ~(size_t) (HEADER_SIZE - 1));
+        if (needed <= GB_ARENA_SIZE - arena.used) {
+          auto header = (BlockHeader*) (arena.buffer + arena.used);
+          header->size = size;
+          header->owner = &arena_owner;
+          arena.used += needed;
+          return (char*) header + HEADER_SIZE;
+        }
+      }
+      return allocate(size);
+    }
+
+    void begin_call() {
+      local.in_call = true;
+      local.call.current = 0;
+      local.call.peak = 0;
+      local.call.allocated = 0;
+    }
+
+    CallMemory end_call() {
+      local.in_call = false;
+      flush();
+      if (local.call.peak > 0) {
+        uint64_t peak = local.call.peak;
+        uint64_t seen = largest_call_peak.load(std::memory_order_relaxed);
+        while (peak > seen && !largest_call_peak.compare_exchange_weak(seen, peak, std::memory_order_relaxed)) { }
+      }
+      return local.call;
+    }
+
+    MemoryTotals totals() {
+      MemoryTotals result;
+      result.current = total_current.load(std::memory_order_relaxed);
+      result.peak = total_peak.load(std::memory_order_relaxed);
+      result.allocated = total_allocated.load(std::memory_order_relaxed);
+      result.allocations = total_allocations.load(std::memory_order_relaxed);
+      result.largest_call_peak = largest_call_peak.load(std::memory_order_relaxed);
+      return result;
+    }
+
+  }
+}
+
+void* gb_malloc(size_t size) {
+  return greenbar::memory::allocate(size);
+}
+
+void* gb_calloc(size_t count, size_t size) {
+  if (size != 0 && count > SIZE_MAX / size) {
+    return nullptr;
+  }
+  void* ptr = greenbar::memory::allocate(count * size);
+  if (ptr != nullptr) {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+void* gb_realloc(void* ptr, size_t size) {
+  return greenbar::memory::reallocate(ptr, size);
+}
+
+void gb_free(void* ptr) {
+  greenbar::memory::release(ptr);
+}
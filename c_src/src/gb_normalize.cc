@@ -0,0 +1,95 @@
+#include "gb_normalize.hpp"
+#include "gb_simd.hpp"
+
+namespace greenbar {
+
+  static inline bool is_blank(uint8_t c) {
+    return c == ' ' || c == '\t';
+  }
+
+  // Length of the fence run a line opens with, 0 if it isn't a fence.
+  // rest is set to the number of bytes after the run.
+  static size_t fence_length(const uint8_t* line, size_t size, uint8_t* fence_char, size_t* rest) {
+    size_t i = 0;
+    while (i < 3 && i < size && line[i] == ' ') {
+      i++;
+    }
+    if (i == size || (line[i] != '`' && line[i] != '~')) {
+      return 0;
+    }
+    uint8_t c = line[i];
+    size_t run = 0;
+    while (i + run < size && line[i + run] == c) {
+      run++;
+    }
+    if (run < 3) {
+      return 0;
+    }
+    *fence_char = c;
+    *rest = size - i - run;
+    return run;
+  }
+
+  bool normalize_whitespace(const uint8_t* data, size_t size, hoedown_buffer* out) {
+    // Most input needs nothing, so look for work before copying anything
+    if (simd::find_line_fixup(data, size) == size) {
+      return false;
+    }
+    out->size = 0;
+    hoedown_buffer_grow(out, size);
+    bool in_fence = false;
+    uint8_t fence_char = 0;
+    size_t fence_run = 0;
+    size_t blank_lines = 0;
+    size_t pos = 0;
+    while (pos < size) {
+      size_t newline = pos + simd::find_byte(data + pos, size - pos, '\n');
+      size_t end = newline;
+      if (end > pos && data[end - 1] == '\r') {
+        end--;
+      }
+      size_t content_end = end;
+      while (content_end > pos && is_blank(data[content_end - 1])) {
+        content_end--;
+      }
+      uint8_t c = 0;
+      size_t rest = 0;
+      size_t run = fence_length(data + pos, content_end - pos, &c, &rest);
+      bool verbatim = false;
+      if (in_fence) {
+        // Closing fences repeat the opening character at least as many
+        // times, with nothing after
+        if (run >= fence_run && c == fence_char && rest == 0) {
+          in_fence = false;
+        } else {
+          verbatim = true;
+        }
+      } else if (run > 0) {
+        in_fence = true;
+        fence_char = c;
+        fence_run = run;
+      }
+      if (verbatim) {
+        blank_lines = 0;
+        hoedown_buffer_put(out, data + pos, end - pos);
+      } else if (content_end == pos) {
+        if (++blank_lines > 1) {
+          pos = newline + 1;
+          continue;
+        }
+      } else {
+        blank_lines = 0;
+        hoedown_buffer_put(out, data + pos, content_end - pos);
+        if (run == 0 && end - content_end >= 2 && data[end - 1] == ' ' && data[end - 2] == ' ') {
+          hoedown_buffer_put(out, (const uint8_t*) "  ", 2);
+        }
+      }
+      if (newline < size) {
+        hoedown_buffer_putc(out, '\n');
+      }
+      pos = newline + 1;
+    }
+    return out->size != size;
+  }
+
+}
@@ -0,0 +1,181 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <new>
+
+#include "gb_ring.hpp"
+
+// Bytes before the first ring
+#define SEGMENT_HEADER_SIZE 64
+
+namespace greenbar {
+
+  struct SegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_bytes;
+  };
+
+  static uint64_t record_bytes(uint64_t size) {
+    return (sizeof(RingRecord) + size + 15) & ~(uint64_t) 15;
+  }
+
+  uint8_t* SharedRing::reserve(size_t size) {
+    if (size > max_payload()) {
+      return nullptr;
+    }
+    uint64_t head = control_->head.load(std::memory_order_relaxed);
+    uint64_t used = head - control_->tail.load(std::memory_order_acquire);
+    uint64_t pos = head % capacity_;
+    uint64_t need = record_bytes(size);
+    skip_ = capacity_ - pos < need ? capacity_ - pos : 0;
+    if (used > capacity_ || capacity_ - used < skip_ + need) {
+      return nullptr;
+    }
+    return data_ + (head + skip_) % capacity_ + sizeof(RingRecord);
+  }
+
+  void SharedRing::commit(size_t size, uint64_t id) {
+    uint64_t head = control_->head.load(std::memory_order_relaxed);
+    if (skip_ > 0) {
+      auto skip = (RingRecord*) (data_ + head % capacity_);
+      skip->size = 0;
+      skip->flags = GB_RING_SKIP;
+      skip->id = 0;
+    }
+    auto record = (RingRecord*) (data_ + (head + skip_) % capacity_);
+    record->size = (uint32_t) size;
+    record->flags = 0;
+    record->id = id;
+    control_->head.store(head + skip_ + record_bytes(size), std::memory_order_release);
+    skip_ = 0;
+  }
+
+  bool SharedRing::peek(RingRecord* record, const uint8_t** payload) {
+    uint64_t tail = control_->tail.load(std::memory_order_relaxed);
+    for (;;) {
+      uint64_t head = control_->head.load(std::memory_order_acquire);
+      if (tail == head) {
+        return false;
+      }
+      uint64_t pos = tail % capacity_;
+      // One read of the header, which the producer could be rewriting
+      RingRecord header = *(const RingRecord*) (data_ + pos);
+      if (header.flags & GB_RING_SKIP) {
+        tail += capacity_ - pos;
+      } else if (head - tail > capacity_ || header.size > capacity_ - pos - sizeof(RingRecord)) {
+        tail = head;
+      } else {
+        *record = header;
+        *payload = data_ + pos + sizeof(RingRecord);
+        peeked_ = record_bytes(header.size);
+        return true;
+      }
+      control_->tail.store(tail, std::memory_order_release);
+    }
+  }
+
+  void SharedRing::release() {
+    uint64_t tail = control_->tail.load(std::memory_order_relaxed);
+    control_->tail.store(tail + peeked_, std::memory_order_release);
+    peeked_ = 0;
+  }
+
+  static uint64_t segment_size(uint64_t ring_bytes) {
+    return SEGMENT_HEADER_SIZE + 2 * (sizeof(RingControl) + ring_bytes);
+  }
+
+  static void bind_rings(RingSegment* segment, uint64_t ring_bytes) {
+    auto base = (uint8_t*) segment->base + SEGMENT_HEADER_SIZE;
+    segment->requests.bind((RingControl*) base, base + sizeof(RingControl), ring_bytes);
+    base += sizeof(RingControl) + ring_bytes;
+    segment->responses.bind((RingControl*) base, base + sizeof(RingControl), ring_bytes);
+  }
+
+  namespace ring {
+
+    int create(const char* name, size_t ring_bytes, RingSegment* segment) {
+      if (ring_bytes < GB_RING_MIN_BYTES) {
+        ring_bytes = GB_RING_MIN_BYTES;
+      }
+      // Keeps both rings' controls on cache line boundaries
+      ring_bytes = (ring_bytes + 63) & ~(size_t) 63;
+      size_t size = segment_size(ring_bytes);
+      int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+      if (fd < 0) {
+        return errno;
+      }
+      void* base = MAP_FAILED;
+      if (ftruncate(fd, size) == 0) {
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      }
+      int error = base == MAP_FAILED ? errno : 0;
+      close(fd);
+      if (error != 0) {
+        shm_unlink(name);
+        return error;
+      }
+      // ftruncate zero fills, so both rings start empty
+      auto header = (SegmentHeader*) base;
+      header->magic = GB_RING_MAGIC;
+      header->version = GB_RING_VERSION;
+      header->ring_bytes = ring_bytes;
+      auto requests = new ((uint8_t*) base + SEGMENT_HEADER_SIZE) RingControl();
+      auto responses = new ((uint8_t*) (requests + 1) + ring_bytes) RingControl();
+      requests->capacity = ring_bytes;
+      responses->capacity = ring_bytes;
+      segment->base = base;
+      segment->size = size;
+      bind_rings(segment, ring_bytes);
+      return 0;
+    }
+
+    int attach(const char* name, RingSegment* segment) {
+      int fd = shm_open(name, O_RDWR, 0);
+      if (fd < 0) {
+        return errno;
+      }
+      struct stat info;
+      int error = 0;
+      void* base = MAP_FAILED;
+      if (fstat(fd, &info) != 0) {
+        error = errno;
+      } else if ((size_t) info.st_size < SEGMENT_HEADER_SIZE) {
+        error = EPROTO;
+      } else {
+        base = mmap(nullptr, (size_t) info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+          error = errno;
+        }
+      }
+      close(fd);
+      if (error != 0) {
+        return error;
+      }
+      auto header = (const SegmentHeader*) base;
+      uint64_t ring_bytes = header->ring_bytes;
+      if (header->magic != GB_RING_MAGIC || header->version != GB_RING_VERSION ||
+          ring_bytes < GB_RING_MIN_BYTES || ring_bytes % 64 != 0 || segment_size(ring_bytes) != (uint64_t) info.st_size) {
+        munmap(base, (size_t) info.st_size);
+        return EPROTO;
+      }
+      // Only the two processes need the segment from here on
+      shm_unlink(name);
+      segment->base = base;
+      segment->size = (size_t) info.st_size;
+      bind_rings(segment, ring_bytes);
+      return 0;
+    }
+
+    void unmap(RingSegment* segment) {
+      if (segment->base != nullptr) {
+        munmap(segment->base, segment->size);
+        segment->base = nullptr;
+        segment->size = 0;
+      }
+    }
+
+  }
+}
@@ -0,0 +1,156 @@
+#include <cstring>
+#include "gb_simd.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define GB_SIMD_SSE2 1
+#endif
+
+namespace greenbar {
+  namespace simd {
+
+    ByteSet::ByteSet() : count_(0) {
+      memset(table_, 0, sizeof(table_));
+    }
+
+    bool ByteSet::add(uint8_t c) {
+      if (table_[c]) {
+        return true;
+      }
+      if (count_ == sizeof(chars_)) {
+        return false;
+      }
+      chars_[count_++] = c;
+      table_[c] = true;
+      return true;
+    }
+
+    size_t find_byte(const uint8_t* data, size_t size, uint8_t c) {
+      auto found = (const uint8_t*) memchr(data, c, size);
+      if (found == nullptr) {
+        return size;
+      }
+      return found - data;
+    }
+
+    size_t find_first_of(const uint8_t* data, size_t size, const ByteSet& set) {
+      size_t i = 0;
+#ifdef GB_SIMD_SSE2
+      __m128i needles[16];
+      size_t count = set.count();
+      for (size_t n = 0; n < count; n++) {
+        needles[n] = _mm_set1_epi8((char) set.chars()[n]);
+      }
+      for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (data + i));
+        __m128i hits = _mm_setzero_si128();
+        for (size_t n = 0; n < count; n++) {
+          hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[n]));
+        }
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+          return i + __builtin_ctz(mask);
+        }
+      }
+#endif
+      for (; i < size; i++) {
+        if (set.contains(data[i])) {
+          return i;
+        }
+      }
+      return size;
+    }
+
+    static inline bool json_escape(uint8_t c) {
+      return c < 0x20 || c == '"' || c == '\\' || c >= 0x80;
+    }
+
+    size_t find_json_escape(const uint8_t* data, size_t size) {
+      size_t i = 0;
+#ifdef GB_SIMD_SSE2
+      __m128i quote = _mm_set1_epi8('"');
+      __m128i backslash = _mm_set1_epi8('\\');
+      __m128i control = _mm_set1_epi8(0x1f);
+      for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (data + i));
+        // Unsigned c <= 0x1f as max(c, 0x1f) == 0x1f
+        __m128i hits = _mm_cmpeq_epi8(_mm_max_epu8(block, control), control);
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, quote));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, backslash));
+        // Bytes from 0x80 have their top bit set already
+        int mask = _mm_movemask_epi8(_mm_or_si128(hits, block));
+        if (mask != 0) {
+          return i + __builtin_ctz(mask);
+        }
+      }
+#endif
+      for (; i < size; i++) {
+        if (json_escape(data[i])) {
+          return i;
+        }
+      }
+      return size;
+    }
+
+    static inline bool is_blank(uint8_t c) {
+      return c == ' ' || c == '\t';
+    }
+
+    size_t find_line_fixup(const uint8_t* data, size_t size) {
+      size_t i = 0;
+#ifdef GB_SIMD_SSE2
+      __m128i cr = _mm_set1_epi8('\r');
+      __m128i lf = _mm_set1_epi8('\n');
+      __m128i space = _mm_set1_epi8(' ');
+      __m128i tab = _mm_set1_epi8('\t');
+      // Each byte is checked along with the two after it
+      for (; i + 18 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (data + i));
+        __m128i next = _mm_loadu_si128((const __m128i*) (data + i + 1));
+        __m128i after = _mm_loadu_si128((const __m128i*) (data + i + 2));
+        __m128i next_lf = _mm_cmpeq_epi8(next, lf);
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab));
+        __m128i hits = _mm_cmpeq_epi8(block, cr);
+        hits = _mm_or_si128(hits, _mm_and_si128(blank, next_lf));
+        hits = _mm_or_si128(hits, _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(block, lf), next_lf),
+                                                _mm_cmpeq_epi8(after, lf)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+          return i + __builtin_ctz(mask);
+        }
+      }
+#endif
+      for (; i < size; i++) {
+        uint8_t c = data[i];
+        if (c == '\r') {
+          return i;
+        }
+        if (is_blank(c) && (i + 1 == size || data[i + 1] == '\n')) {
+          return i;
+        }
+        if (c == '\n' && i + 2 < size && data[i + 1] == '\n' && data[i + 2] == '\n') {
+          return i;
+        }
+      }
+      return size;
+    }
+
+    size_t count_byte(const uint8_t* data, size_t size, uint8_t c) {
+      size_t i = 0, total = 0;
+#ifdef GB_SIMD_SSE2
+      __m128i needle = _mm_set1_epi8((char) c);
+      for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (data + i));
+        total += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+      }
+#endif
+      for (; i < size; i++) {
+        if (data[i] == c) {
+          total++;
+        }
+      }
+      return total;
+    }
+
+  }
+}
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "gb_slowlog.hpp"
+
+namespace greenbar {
+  namespace slowlog {
+
+    // Min-heap on duration, so the fastest kept entry is the one replaced
+    struct SlowLog {
+      std::mutex lock;
+      SlowLogConfig config;
+      std::vector<SlowParse> heap;
+      // Copy of config.threshold_us checked without the lock
+      std::atomic<uint64_t> threshold_us;
+      // Duration of the fastest kept entry once the log is full, else 0.
+      // Parses no slower than it aren't kept.
+      std::atomic<uint64_t> floor_us;
+      SlowLog() {
+        threshold_us.store(config.threshold_us, std::memory_order_relaxed);
+        floor_us.store(0, std::memory_order_relaxed);
+      }
+    };
+
+    static bool slower(const SlowParse& a, const SlowParse& b) {
+      return a.duration_us > b.duration_us;
+    }
+
+    // Called with the lock held after the heap changes
+    static void update_floor(SlowLog& log) {
+      uint64_t floor = log.heap.size() < log.config.capacity ? 0 : log.heap.front().duration_us;
+      log.floor_us.store(floor, std::memory_order_relaxed);
+    }
+
+    static bool same_parse(const SlowParse& a, const SlowParse& b) {
+      return a.at_ms == b.at_ms && a.hash == b.hash && a.duration_us == b.duration_us;
+    }
+
+    static SlowLog& slow_log() {
+      static SlowLog* instance = new SlowLog();
+      return *instance;
+    }
+
+    static uint64_t fnv1a(const uint8_t* data, size_t size) {
+      uint64_t hash = 14695981039346656037ULL;
+      for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+      }
+      return hash;
+    }
+
+    static void apply(SlowLog& log, const SlowLogConfig& config) {
+      log.config = config;
+      if (log.config.sample_bytes > GB_SLOW_SAMPLE_MAX) {
+        log.config.sample_bytes = GB_SLOW_SAMPLE_MAX;
+      }
+      log.heap.clear();
+      log.floor_us.store(0, std::memory_order_relaxed);
+      log.threshold_us.store(log.config.capacity > 0 ? log.config.threshold_us : 0, std::memory_order_relaxed);
+    }
+
+    void configure(const SlowLogConfig& config) {
+      auto& log = slow_log();
+      std::lock_guard<std::mutex> guard(log.lock);
+      apply(log, config);
+    }
+
+    SlowLogConfig config() {
+      auto& log = slow_log();
+      std::lock_guard<std::mutex> guard(log.lock);
+      return log.config;
+    }
+
+    bool wants(uint64_t duration_us) {
+      auto& log = slow_log();
+      uint64_t threshold = log.threshold_us.load(std::memory_order_relaxed);
+      return threshold > 0 && duration_us >= threshold && duration_us > log.floor_us.load(std::memory_order_relaxed);
+    }
+
+    void record(const uint8_t* data, size_t size, uint64_t duration_us, uint64_t render_us, size_t nodes,
+                LimitType limit) {
+      if (!wants(duration_us)) {
+        return;
+      }
+      auto& log = slow_log();
+      SlowParse entry;
+      entry.duration_us = duration_us;
+      entry.render_us = render_us;
+      entry.bytes = size;
+      entry.nodes = nodes;
+      entry.limit = limit;
+      // Hashing the whole input is cheap next to a parse this slow
+      entry.hash = fnv1a(data, size);
+      entry.at_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+      std::lock_guard<std::mutex> guard(log.lock);
+      if (log.config.capacity == 0) {
+        return;
+      }
+      // Another thread may have filled the log with slower parses since wants
+      if (log.heap.size() == log.config.capacity) {
+        if (duration_us <= log.heap.front().duration_us) {
+          return;
+        }
+        std::pop_heap(log.heap.begin(), log.heap.end(), slower);
+        log.heap.pop_back();
+      }
+      entry.sample.assign((const char*) data, std::min(size, log.config.sample_bytes));
+      log.heap.push_back(std::move(entry));
+      std::push_heap(log.heap.begin(), log.heap.end(), slower);
+      update_floor(log);
+    }
+
+    void entries(std::vector<SlowParse>* out) {
+      auto& log = slow_log();
+      {
+        std::lock_guard<std::mutex> guard(log.lock);
+        *out = log.heap;
+      }
+      std::sort(out->begin(), out->end(), slower);
+    }
+
+    void restore(const SlowLogConfig& config, const std::vector<SlowParse>& entries) {
+      auto& log = slow_log();
+      std::lock_guard<std::mutex> guard(log.lock);
+      apply(log, config);
+      if (log.config.capacity == 0) {
+        return;
+      }
+      // Keep the slowest, whatever order they come in
+      std::vector<SlowParse> sorted(entries);
+      std::sort(sorted.begin(), sorted.end(), slower);
+      if (sorted.size() > log.config.capacity) {
+        sorted.resize(log.config.capacity);
+      }
+      log.heap = std::move(sorted);
+      std::make_heap(log.heap.begin(), log.heap.end(), slower);
+      update_floor(log);
+    }
+
+    void merge(const std::vector<SlowParse>& entries) {
+      auto& log = slow_log();
+      std::lock_guard<std::mutex> guard(log.lock);
+      if (log.config.threshold_us == 0 || log.config.capacity == 0) {
+        return;
+      }
+      for (auto& entry : entries) {
+        if (entry.duration_us < log.config.threshold_us ||
+            std::any_of(log.heap.begin(), log.heap.end(),
+                        [&entry](const SlowParse& kept) { return same_parse(kept, entry); })) {
+          continue;
+        }
+        if (log.heap.size() == log.config.capacity) {
+          if (entry.duration_us <= log.heap.front().duration_us) {
+            continue;
+          }
+          std::pop_heap(log.heap.begin(), log.heap.end(), slower);
+          log.heap.pop_back();
+        }
+        log.heap.push_back(entry);
+        if (log.heap.back().sample.size() > log.config.sample_bytes) {
+          log.heap.back().sample.resize(log.config.sample_bytes);
+        }
+        std::push_heap(log.heap.begin(), log.heap.end(), slower);
+      }
+      update_floor(log);
+    }
+
+  }
+}
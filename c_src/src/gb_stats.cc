@@ -0,0 +1,156 @@
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "gb_stats.hpp"
+
+namespace greenbar {
+  namespace stats {
+
+    // Only the owning thread writes a block, so increments are a relaxed
+    // load and store rather than a locked read-modify-write
+    struct StatsBlock {
+      std::atomic<uint64_t> counters[STAT_COUNTER_COUNT];
+      std::atomic<uint64_t> nodes[GB_NODE_TYPES];
+      std::atomic<uint64_t> histograms[HIST_COUNT][GB_HISTOGRAM_BUCKETS];
+
+      StatsBlock() {
+        for (auto& value : counters) {
+          value.store(0, std::memory_order_relaxed);
+        }
+        for (auto& value : nodes) {
+          value.store(0, std::memory_order_relaxed);
+        }
+        for (auto& histogram : histograms) {
+          for (auto& value : histogram) {
+            value.store(0, std::memory_order_relaxed);
+          }
+        }
+      }
+
+      void merge_into(StatsSnapshot* out) {
+        for (size_t i = 0; i < STAT_COUNTER_COUNT; i++) {
+          out->counters[i] += counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < GB_NODE_TYPES; i++) {
+          out->nodes[i] += nodes[i].load(std::memory_order_relaxed);
+        }
+        for (size_t h = 0; h < HIST_COUNT; h++) {
+          for (size_t i = 0; i < GB_HISTOGRAM_BUCKETS; i++) {
+            out->histograms[h][i] += histograms[h][i].load(std::memory_order_relaxed);
+          }
+        }
+      }
+    };
+
+    static inline void bump(std::atomic<uint64_t>& value, uint64_t n) {
+      value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // Live thread blocks and the folded totals of threads that have exited
+    struct Registry {
+      std::mutex lock;
+      std::vector<StatsBlock*> blocks;
+      StatsSnapshot retired;
+      Registry() : retired() { }
+    };
+
+    static Registry& registry() {
+      static Registry* instance = new Registry();
+      return *instance;
+    }
+
+    class ThreadStats {
+    public:
+      StatsBlock block;
+      ThreadStats() {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> guard(reg.lock);
+        reg.blocks.push_back(&block);
+      }
+      ~ThreadStats() {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> guard(reg.lock);
+        block.merge_into(&reg.retired);
+        for (auto iter = reg.blocks.begin(); iter != reg.blocks.end(); ++iter) {
+          if (*iter == &block) {
+            reg.blocks.erase(iter);
+            break;
+          }
+        }
+      }
+    };
+
+    static StatsBlock& local_block() {
+      static thread_local ThreadStats local;
+      return local.block;
+    }
+
+    void add(StatCounter counter, uint64_t n) {
+      bump(local_block().counters[counter], n);
+    }
+
+    void add_node(node2::NodeType type) {
+      size_t index = type - node2::MD_NONE;
+      if (index < GB_NODE_TYPES) {
+        bump(local_block().nodes[index], 1);
+      }
+    }
+
+    void record(StatHistogram histogram, uint64_t value) {
+      size_t bucket = 0;
+      while (value > 0 && bucket < GB_HISTOGRAM_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+      }
+      bump(local_block().histograms[histogram][bucket], 1);
+    }
+
+    uint64_t bucket_limit(size_t bucket) {
+      if (bucket >= GB_HISTOGRAM_BUCKETS - 1) {
+        return 0;
+      }
+      return ((uint64_t) 1) << bucket;
+    }
+
+    void snapshot(StatsSnapshot* out) {
+      auto& reg = registry();
+      std::lock_guard<std::mutex> guard(reg.lock);
+      *out = reg.retired;
+      for (auto block : reg.blocks) {
+        block->merge_into(out);
+      }
+    }
+
+    void absorb(const StatsSnapshot& totals) {
+      auto& reg = registry();
+      std::lock_guard<std::mutex> guard(reg.lock);
+      for (size_t i = 0; i < STAT_COUNTER_COUNT; i++) {
+        reg.retired.counters[i] += totals.counters[i];
+      }
+      for (size_t i = 0; i < GB_NODE_TYPES; i++) {
+        reg.retired.nodes[i] += totals.nodes[i];
+      }
+      for (size_t h = 0; h < HIST_COUNT; h++) {
+        for (size_t i = 0; i < GB_HISTOGRAM_BUCKETS; i++) {
+          reg.retired.histograms[h][i] += totals.histograms[h][i];
+        }
+      }
+    }
+
+    void subtract(StatsSnapshot* totals, const StatsSnapshot& earlier) {
+      for (size_t i = 0; i < STAT_COUNTER_COUNT; i++) {
+        totals->counters[i] -= earlier.counters[i];
+      }
+      for (size_t i = 0; i < GB_NODE_TYPES; i++) {
+        totals->nodes[i] -= earlier.nodes[i];
+      }
+      for (size_t h = 0; h < HIST_COUNT; h++) {
+        for (size_t i = 0; i < GB_HISTOGRAM_BUCKETS; i++) {
+          totals->histograms[h][i] -= earlier.histograms[h][i];
+        }
+      }
+    }
+
+  }
+}
@@ -0,0 +1,306 @@
+#include <cstring>
+#include <vector>
+#include "gb_term_builder.hpp"
+#include "gb_simd.hpp"
+#include "gb_stats.hpp"
+#include "md_node.hpp"
+
+using namespace greenbar::node2;
+
+namespace greenbar {
+
+  ERL_NIF_TERM type_to_atom(NodeType type, gb_priv_s* priv_data) {
+    switch(type) {
+    case MD_EOL:
+      return priv_data->gb_atom_newline;
+    case MD_PARAGRAPH:
+      return priv_data->gb_atom_paragraph;
+    case MD_TEXT:
+      return priv_data->gb_atom_text;
+    case MD_FIXED_WIDTH:
+      return priv_data->gb_atom_fixed_width;
+    case MD_FIXED_WIDTH_BLOCK:
+      return priv_data->gb_atom_fixed_width_block;
+    case MD_HEADER:
+      return priv_data->gb_atom_header;
+    case MD_ITALICS:
+      return priv_data->gb_atom_italics;
+    case MD_BOLD:
+      return priv_data->gb_atom_bold;
+    case MD_STRIKETHROUGH:
+      return priv_data->gb_atom_strikethrough;
+    case MD_LINK:
+      return priv_data->gb_atom_link;
+    case MD_LIST_ITEM:
+      return priv_data->gb_atom_list_item;
+    case MD_ORDERED_LIST:
+      return priv_data->gb_atom_ordered_list;
+    case MD_UNORDERED_LIST:
+      return priv_data->gb_atom_unordered_list;
+    case MD_TABLE_CELL:
+      return priv_data->gb_atom_table_cell;
+    case MD_TABLE_ROW:
+      return priv_data->gb_atom_table_row;
+    case MD_TABLE_HEADER:
+      return priv_data->gb_atom_table_header;
+    case MD_TABLE:
+      return priv_data->gb_atom_table;
+    default:
+      return priv_data->gb_atom_text;
+    }
+  }
+
+  ERL_NIF_TERM alignment_to_atom(NodeAlignment align, gb_priv_s* priv_data) {
+    switch(align) {
+    case ALIGN_RIGHT:
+      return priv_data->gb_atom_right;
+    case ALIGN_CENTER:
+      return priv_data->gb_atom_center;
+    default:
+      return priv_data->gb_atom_left;
+    }
+  }
+
+  static ERL_NIF_TERM make_binary(ErlNifEnv* env, const NodeString& value) {
+    ERL_NIF_TERM bin;
+    auto data = enif_make_new_binary(env, value.size(), &bin);
+    memcpy(data, value.data(), value.size());
+    return bin;
+  }
+
+  // Terms can be shared freely within an env, so repeated text is made once
+  static ERL_NIF_TERM make_binary(TermContext& ctx, const NodeString& value) {
+    if (ctx.strings == nullptr || value.size() > GB_INTERN_MAX_SIZE) {
+      return make_binary(ctx.env, value);
+    }
+    TextKey key = {value.data(), value.size()};
+    auto found = ctx.strings->find(key);
+    if (found != ctx.strings->end()) {
+      return found->second;
+    }
+    ERL_NIF_TERM bin = make_binary(ctx.env, value);
+    ctx.strings->insert(std::make_pair(key, bin));
+    return bin;
+  }
+
+  static ERL_NIF_TERM put_text(TermContext& ctx, MarkdownNode* node, ERL_NIF_TERM term) {
+    auto& text = node->get_text();
+    if (text.size() > 0) {
+      enif_make_map_put(ctx.env, term, ctx.priv_data->gb_atom_text, make_binary(ctx, text), &term);
+    }
+    return term;
+  }
+
+  // Splits text into pages of at most budget bytes, breaking after the last
+  // newline that fits. The newline itself is left out. Lines longer than the
+  // budget are cut on a UTF-8 character boundary.
+  static void split_pages(const uint8_t* data, size_t size, size_t budget, std::vector<TextKey>* pages) {
+    size_t start = 0;
+    while (start < size) {
+      if (size - start <= budget) {
+        pages->push_back({(const char*) data + start, size - start});
+        return;
+      }
+      size_t limit = start + budget;
+      size_t cut = start;
+      size_t pos = start;
+      // A newline right at the limit still ends a full page
+      while (pos <= limit) {
+        size_t found = pos + simd::find_byte(data + pos, limit + 1 - pos, '\n');
+        if (found > limit) {
+          break;
+        }
+        cut = found;
+        pos = found + 1;
+      }
+      if (cut > start) {
+        pages->push_back({(const char*) data + start, cut - start});
+        start = cut + 1;
+        continue;
+      }
+      cut = limit;
+      while (cut > start && (data[cut] & 0xc0) == 0x80) {
+        cut--;
+      }
+      if (cut == start) {
+        cut = limit;
+      }
+      pages->push_back({(const char*) data + start, cut - start});
+      start = cut;
+    }
+  }
+
+  // #{name => fixed_width_block, text => Text, pages => [Page]} where the
+  // pages are sub-binaries of the text. The text is copied into a binary of
+  // the VM's own rather than handed over: node text carries a pointer back
+  // to this library's allocator, which an upgrade may unload before the
+  // binary goes.
+  static ERL_NIF_TERM put_pages(TermContext& ctx, MarkdownNode* node, ERL_NIF_TERM term) {
+    ERL_NIF_TERM text = make_binary(ctx.env, node->get_text());
+    ErlNifBinary bin;
+    enif_inspect_binary(ctx.env, text, &bin);
+    std::vector<TextKey> pages;
+    split_pages(bin.data, bin.size, ctx.page_bytes, &pages);
+    ERL_NIF_TERM tail = enif_make_list(ctx.env, 0);
+    for (auto iter = pages.rbegin(); iter != pages.rend(); ++iter) {
+      size_t offset = (const uint8_t*) iter->data - bin.data;
+      tail = enif_make_list_cell(ctx.env, enif_make_sub_binary(ctx.env, text, offset, iter->size), tail);
+    }
+    enif_make_map_put(ctx.env, term, ctx.priv_data->gb_atom_text, text, &term);
+    enif_make_map_put(ctx.env, term, ctx.priv_data->gb_atom_pages, tail, &term);
+    return term;
+  }
+
+  // Children are stored last to first so consing them up restores document order
+  static ERL_NIF_TERM put_children(TermContext& ctx, MarkdownNodeContainer* node, ERL_NIF_TERM term) {
+    ERL_NIF_TERM head, tail;
+    tail = enif_make_list(ctx.env, 0);
+    for (auto child : node->get_children()) {
+      // Caller discards partial results once a limit trips
+      if (!ctx.limits->tick()) {
+        break;
+      }
+      head = node_to_term(ctx, child);
+      tail = enif_make_list_cell(ctx.env, head, tail);
+    }
+    enif_make_map_put(ctx.env, term, ctx.priv_data->gb_atom_children, tail, &term);
+    return term;
+  }
+
+  static ERL_NIF_TERM put_header(TermContext& ctx, MarkdownNode* node, ERL_NIF_TERM term) {
+    term = put_text(ctx, node, term);
+    auto level_attr = node->get_attribute(ATTR_LEVEL);
+    ERL_NIF_TERM level = enif_make_int(ctx.env, level_attr.n());
+    enif_make_map_put(ctx.env, term, ctx.priv_data->gb_atom_level, level, &term);
+    return term;
+  }
+
+  static ERL_NIF_TERM put_link(TermContext& ctx, MarkdownNode* node, ERL_NIF_TERM term) {
+    auto value = node->get_attribute(ATTR_URL);
+    enif_make_map_put(ctx.env, term, ctx.priv_data->gb_atom_url, make_binary(ctx, value.s()), &term);
+    enif_make_map_put(ctx.env, term, ctx.priv_data->gb_atom_text, make_binary(ctx, node->get_text()), &term);
+    return term;
+  }
+
+  static ERL_NIF_TERM put_cell(TermContext& ctx, MarkdownNodeContainer* node, ERL_NIF_TERM term) {
+    term = put_children(ctx, node, term);
+    if (!node->has_attribute(ATTR_ALIGNMENT)) {
+      return term;
+    }
+    auto value = node->get_attribute(ATTR_ALIGNMENT);
+    NodeAlignment alignment = (NodeAlignment) value.n();
+    if (alignment == ALIGN_NONE) {
+      return term;
+    }
+    enif_make_map_put(ctx.env, term, ctx.priv_data->gb_atom_alignment,
+                      alignment_to_atom(alignment, ctx.priv_data), &term);
+    return term;
+  }
+
+  static ERL_NIF_TERM cell_text(TermContext& ctx, MarkdownNode* cell) {
+    auto& content = static_cast<MarkdownNodeContainer*>(cell)->get_children();
+    if (content.empty()) {
+      return make_binary(ctx, NodeString());
+    }
+    return make_binary(ctx, content[0]->get_text());
+  }
+
+  // Column oriented layout:
+  // #{name => table, header => [Text], alignments => [Align], rows => [{Text, ...}]}
+  // Rows are grouped as row_batches => [[{Text, ...}]] when a batch size is set.
+  // Children are stored last to first, so rows and cells are read backwards.
+  static ERL_NIF_TERM put_columnar_table(TermContext& ctx, TableNode* table, ERL_NIF_TERM term) {
+    ErlNifEnv* env = ctx.env;
+    gb_priv_s* priv_data = ctx.priv_data;
+    auto& children = table->get_children();
+    ERL_NIF_TERM header = enif_make_list(env, 0);
+    ERL_NIF_TERM alignments = enif_make_list(env, 0);
+    std::vector<ERL_NIF_TERM> cells;
+    std::vector<ERL_NIF_TERM> rows;
+    rows.reserve(children.size());
+    for (auto row_iter = children.rbegin(); row_iter != children.rend(); ++row_iter) {
+      if (!ctx.limits->tick()) {
+        return term;
+      }
+      auto row = static_cast<MarkdownNodeContainer*>(*row_iter);
+      auto& row_cells = row->get_children();
+      if (row->get_type() == MD_TABLE_HEADER) {
+        for (auto cell : row_cells) {
+          header = enif_make_list_cell(env, cell_text(ctx, cell), header);
+          ERL_NIF_TERM align = priv_data->gb_atom_none;
+          if (cell->has_attribute(ATTR_ALIGNMENT)) {
+            auto value = cell->get_attribute(ATTR_ALIGNMENT);
+            if (value.n() != ALIGN_NONE) {
+              align = alignment_to_atom((NodeAlignment) value.n(), priv_data);
+            }
+          }
+          alignments = enif_make_list_cell(env, align, alignments);
+        }
+        continue;
+      }
+      cells.clear();
+      for (auto cell_iter = row_cells.rbegin(); cell_iter != row_cells.rend(); ++cell_iter) {
+        cells.push_back(cell_text(ctx, *cell_iter));
+      }
+      rows.push_back(enif_make_tuple_from_array(env, cells.data(), cells.size()));
+    }
+    enif_make_map_put(env, term, priv_data->gb_atom_header, header, &term);
+    enif_make_map_put(env, term, priv_data->gb_atom_alignments, alignments, &term);
+    if (ctx.table_batch_size == 0) {
+      ERL_NIF_TERM row_list = enif_make_list_from_array(env, rows.data(), rows.size());
+      enif_make_map_put(env, term, priv_data->gb_atom_rows, row_list, &term);
+      return term;
+    }
+    ERL_NIF_TERM batches = enif_make_list(env, 0);
+    size_t batch_count = (rows.size() + ctx.table_batch_size - 1) / ctx.table_batch_size;
+    for (size_t i = batch_count; i > 0; i--) {
+      size_t start = (i - 1) * ctx.table_batch_size;
+      size_t count = rows.size() - start;
+      if (count > ctx.table_batch_size) {
+        count = ctx.table_batch_size;
+      }
+      ERL_NIF_TERM batch = enif_make_list_from_array(env, rows.data() + start, count);
+      batches = enif_make_list_cell(env, batch, batches);
+    }
+    enif_make_map_put(env, term, priv_data->gb_atom_row_batches, batches, &term);
+    return term;
+  }
+
+  ERL_NIF_TERM node_to_term(TermContext& ctx, MarkdownNode* node) {
+    stats::add_node(node->get_type());
+    if (ctx.profile != nullptr) {
+      ctx.profile->nodes[node->get_type() - MD_NONE]++;
+    }
+    ERL_NIF_TERM term = enif_make_new_map(ctx.env);
+    enif_make_map_put(ctx.env, term, ctx.priv_data->gb_atom_name, type_to_atom(node->get_type(), ctx.priv_data), &term);
+    switch(node->get_type()) {
+    case MD_HEADER:
+      return put_header(ctx, node, term);
+    case MD_LINK:
+      return put_link(ctx, node, term);
+    case MD_FIXED_WIDTH_BLOCK:
+      if (ctx.page_bytes > 0) {
+        return put_pages(ctx, node, term);
+      }
+      break;
+    case MD_TABLE_CELL:
+      return put_cell(ctx, static_cast<MarkdownNodeContainer*>(node), term);
+    case MD_TABLE: {
+      auto table = static_cast<TableNode*>(node);
+      if (ctx.tables == TABLES_COLUMNAR && table->is_plain()) {
+        return put_columnar_table(ctx, table, term);
+      }
+      return put_children(ctx, table, term);
+    }
+    default:
+      break;
+    }
+    // Header rows share their type with the childless header marker
+    auto container = dynamic_cast<MarkdownNodeContainer*>(node);
+    if (container != nullptr) {
+      return put_children(ctx, container, term);
+    }
+    return put_text(ctx, node, term);
+  }
+
+}
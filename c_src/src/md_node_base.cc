@@ -2,24 +2,13 @@
 
 namespace greenbar {
   namespace node2 {
-    ERL_NIF_TERM MarkdownNode::decorate_term(ErlNifEnv* env, ERL_NIF_TERM term) {
-      if (text_.size() > 0) {
-        ERL_NIF_TERM text;
-        gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
-        auto text_bin = enif_make_new_binary(env, text_.size(), &text);
-        memcpy(text_bin, text_.c_str(), text_.size());
-        enif_make_map_put(env, term, priv_data->gb_atom_text, text, &term);
-      }
-      return term;
-    }
-
     MarkdownNode::MarkdownNode(NodeType type) {
         type_ = type;
         text_ = "";
         terminates_line_ = false;
     }
 
-    MarkdownNode::MarkdownNode(NodeType type, const std::string& text) {
+    MarkdownNode::MarkdownNode(NodeType type, const NodeString& text) {
       type_ = type;
       text_ = text;
       terminates_line_ = false;
@@ -45,8 +34,8 @@ namespace greenbar {
 
     std::string MarkdownNode::to_string() {
       auto text = type_to_string(type_);
-      if (text_ != "") {
-        text = text + ": \"" + text_ + "\"";
+      if (!text_.empty()) {
+        text = text + ": \"" + std::string(text_.data(), text_.size()) + "\"";
       }
       return text;
     }
@@ -61,34 +50,6 @@ namespace greenbar {
       return previous;
     }
 
-    ERL_NIF_TERM MarkdownNode::to_erl_term(ErlNifEnv* env) {
-      gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
-      ERL_NIF_TERM type_name = type_to_atom(this->type_, priv_data);
-      ERL_NIF_TERM retval = enif_make_new_map(env);
-      enif_make_map_put(env, retval, priv_data->gb_atom_name, type_name, &retval);
-      return decorate_term(env, retval);
-    }
-
-    ERL_NIF_TERM MarkdownNodeContainer::children_to_term_list(ErlNifEnv* env) {
-      ERL_NIF_TERM head, tail;
-      tail = enif_make_list(env, 0);
-      if (children_.empty()) {
-        return tail;
-      }
-      for(size_t i = 0; i < children_.size(); i++) {
-        auto child = children_.at(i);
-        head = child->to_erl_term(env);
-        tail = enif_make_list_cell(env, head, tail);
-      }
-      return tail;
-    }
-    ERL_NIF_TERM MarkdownNodeContainer::decorate_term(ErlNifEnv* env, ERL_NIF_TERM term) {
-      auto child_terms = children_to_term_list(env);
-      gb_priv_s *priv_data = (gb_priv_s*) enif_priv_data(env);
-      enif_make_map_put(env, term, priv_data->gb_atom_children, child_terms, &term);
-      return term;
-    }
-
     MarkdownNodeContainer::~MarkdownNodeContainer() {
       while(!children_.empty()) {
         auto child = children_.back();
@@ -112,6 +73,9 @@ namespace greenbar {
 
     void MarkdownNodeContainer::add_child(MarkdownNode* child) {
       children_.push_back(child);
+      if (child->depth() + 1 > depth_) {
+        depth_ = child->depth() + 1;
+      }
     }
 
     bool MarkdownNodeContainer::empty() {
@@ -0,0 +1,42 @@
+#include "parse_limits.hpp"
+
+namespace greenbar {
+
+  void LimitTracker::reset(const ParseLimits& limits) {
+    limits_ = limits;
+    nodes_ = 0;
+    ticks_ = 0;
+    exceeded_ = LIMIT_NONE;
+    if (limits_.timeout_ms > 0) {
+      deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(limits_.timeout_ms);
+    }
+  }
+
+  bool LimitTracker::check_input(size_t size) {
+    if (limits_.max_input_size > 0 && size > limits_.max_input_size) {
+      return fail(LIMIT_INPUT_SIZE);
+    }
+    return true;
+  }
+
+  bool LimitTracker::check_depth(size_t depth) {
+    if (exceeded()) {
+      return false;
+    }
+    if (limits_.max_nesting > 0 && depth > limits_.max_nesting) {
+      return fail(LIMIT_NESTING);
+    }
+    return true;
+  }
+
+  bool LimitTracker::check_deadline() {
+    if (exceeded()) {
+      return false;
+    }
+    if (limits_.timeout_ms > 0 && std::chrono::steady_clock::now() >= deadline_) {
+      return fail(LIMIT_TIMEOUT);
+    }
+    return true;
+  }
+
+}
@@ -0,0 +1,53 @@
+#include <cstring>
+
+#include "parse_profile.hpp"
+
+namespace greenbar {
+
+  static const char* callback_names[CB_COUNT] = {
+    "blockcode",
+    "header",
+    "paragraph",
+    "list",
+    "listitem",
+    "table",
+    "table_header",
+    "table_row",
+    "table_cell",
+    "autolink",
+    "codespan",
+    "emphasis",
+    "double_emphasis",
+    "strikethrough",
+    "link",
+    "linebreak",
+    "normal_text"
+  };
+
+  ParseProfile::ParseProfile() {
+    memset(this, 0, sizeof(ParseProfile));
+  }
+
+  const char* callback_name(ProfileCallback callback) {
+    return callback_names[callback];
+  }
+
+  namespace profile {
+
+    static thread_local ParseProfile* tracking = nullptr;
+
+    void track_allocations(ParseProfile* profile) {
+      tracking = profile;
+    }
+
+    void count_allocation(size_t bytes) {
+      auto profile = tracking;
+      if (profile != nullptr) {
+        profile->allocations++;
+        profile->bytes_allocated += bytes;
+      }
+    }
+
+  }
+
+}
@@ -0,0 +1,265 @@
+#include <cstring>
+
+#include "document.h"
+#include "pipe_table.hpp"
+
+#define UTF8_BOM "\xEF\xBB\xBF"
+
+namespace greenbar {
+
+  PipeTableScanner::PipeTableScanner(const uint8_t* data, size_t size, unsigned int extensions, size_t min_rows)
+    : data_(data), size_(size), pos_(0), min_rows_(min_rows), enabled_(true), prev_blank_(true),
+      fenced_code_((extensions & HOEDOWN_EXT_FENCED_CODE) != 0), fence_char_(0), fence_width_(0) {
+    // Bytes hoedown treats as inline markup. A cell holding any of them
+    // is not a single text run.
+    const char* chars = "*_`[!<\\&\t";
+    for (const char* c = chars; *c != '\0'; c++) {
+      inline_chars_.add(*c);
+    }
+    if (extensions & HOEDOWN_EXT_STRIKETHROUGH) {
+      inline_chars_.add('~');
+    }
+    if (extensions & HOEDOWN_EXT_HIGHLIGHT) {
+      inline_chars_.add('=');
+    }
+    if (extensions & HOEDOWN_EXT_AUTOLINK) {
+      inline_chars_.add(':');
+      inline_chars_.add('@');
+      inline_chars_.add('w');
+    }
+    if (extensions & HOEDOWN_EXT_SUPERSCRIPT) {
+      inline_chars_.add('^');
+    }
+    if (extensions & HOEDOWN_EXT_QUOTE) {
+      inline_chars_.add('"');
+    }
+    if (extensions & HOEDOWN_EXT_MATH) {
+      inline_chars_.add('$');
+    }
+    // hoedown rewrites line endings and strips reference definitions
+    // before parsing blocks. Leave those documents to it entirely.
+    if ((extensions & HOEDOWN_EXT_TABLES) == 0 || simd::find_byte(data, size, '\r') < size) {
+      enabled_ = false;
+      return;
+    }
+    size_t i = 0;
+    while ((i += simd::find_byte(data + i, size - i, ']')) < size) {
+      if (++i < size && data[i] == ':') {
+        enabled_ = false;
+        return;
+      }
+    }
+  }
+
+  size_t PipeTableScanner::line_end(size_t begin) {
+    return begin + simd::find_byte(data_ + begin, size_ - begin, '\n');
+  }
+
+  // Tracks fenced code blocks so tables inside them are left alone. Only
+  // unindented fences after a blank line are followed; returns false for
+  // any other fence-like line since hoedown may read it differently.
+  bool PipeTableScanner::update_fence(size_t begin, size_t end) {
+    size_t i = begin;
+    while (i < end && (data_[i] == ' ' || data_[i] == '\t')) {
+      i++;
+    }
+    if (i == end || (data_[i] != '`' && data_[i] != '~')) {
+      return true;
+    }
+    uint8_t c = data_[i];
+    size_t run = i;
+    while (run < end && data_[run] == c) {
+      run++;
+    }
+    size_t width = run - i;
+    if (width < 3) {
+      return true;
+    }
+    if (i != begin) {
+      return false;
+    }
+    bool trailing_blank = true;
+    bool repeats = false;
+    for (size_t j = run; j < end; j++) {
+      if (data_[j] != ' ') {
+        trailing_blank = false;
+      }
+      if (data_[j] == c) {
+        repeats = true;
+      }
+    }
+    if (fence_width_ == 0) {
+      if (!prev_blank_ || repeats) {
+        return false;
+      }
+      fence_char_ = c;
+      fence_width_ = width;
+      return true;
+    }
+    if (c != fence_char_ || width != fence_width_ || !trailing_blank) {
+      return false;
+    }
+    fence_width_ = 0;
+    return true;
+  }
+
+  // Mirrors hoedown's header underline parsing
+  bool PipeTableScanner::scan_separator(size_t begin, size_t end, PipeTable* table) {
+    size_t i = begin;
+    if (i < end && data_[i] == '|') {
+      i++;
+    }
+    size_t col = 0;
+    for (; col < table->columns && i < end; ++col) {
+      size_t dashes = 0;
+      unsigned int flags = 0;
+      while (i < end && data_[i] == ' ') {
+        i++;
+      }
+      if (i < end && data_[i] == ':') {
+        i++;
+        flags |= HOEDOWN_TABLE_ALIGN_LEFT;
+        dashes++;
+      }
+      while (i < end && data_[i] == '-') {
+        i++;
+        dashes++;
+      }
+      if (i < end && data_[i] == ':') {
+        i++;
+        flags |= HOEDOWN_TABLE_ALIGN_RIGHT;
+        dashes++;
+      }
+      while (i < end && data_[i] == ' ') {
+        i++;
+      }
+      if ((i < end && data_[i] != '|' && data_[i] != '+') || dashes < 3) {
+        break;
+      }
+      table->column_flags[col] = flags;
+      i++;
+    }
+    return col == table->columns;
+  }
+
+  // Mirrors hoedown's row splitting. Rows with empty or missing
+  // cells are rejected rather than padded.
+  bool PipeTableScanner::split_row(size_t begin, size_t end, PipeTable* table) {
+    size_t i = begin;
+    if (i < end && data_[i] == '|') {
+      i++;
+    }
+    size_t col = 0;
+    for (; col < table->columns && i < end; ++col) {
+      while (i < end && data_[i] == ' ') {
+        i++;
+      }
+      size_t cell_start = i;
+      size_t len = simd::find_byte(data_ + i, end - i, '|');
+      if (len == end - i) {
+        len = 0;
+      }
+      if (len == 0 && i < end && data_[i] != '|') {
+        len = end - i;
+      }
+      i += len;
+      size_t cell_end = i;
+      while (cell_end > cell_start && data_[cell_end - 1] == ' ') {
+        cell_end--;
+      }
+      if (cell_end == cell_start) {
+        return false;
+      }
+      table->cells.push_back({cell_start, cell_end});
+      i++;
+    }
+    return col == table->columns;
+  }
+
+  bool PipeTableScanner::scan_table(size_t begin, PipeTable* table) {
+    size_t header_end = line_end(begin);
+    if (header_end == size_) {
+      return false;
+    }
+    size_t trimmed = header_end;
+    while (trimmed > begin && data_[trimmed - 1] == ' ') {
+      trimmed--;
+    }
+    // Leading and trailing pipes don't separate columns
+    long pipes = simd::count_byte(data_ + begin, header_end - begin, '|') - 1;
+    if (data_[trimmed - 1] == '|') {
+      pipes--;
+    }
+    if (pipes < 0) {
+      return false;
+    }
+    table->start = begin;
+    table->columns = pipes + 1;
+    table->column_flags.assign(table->columns, 0);
+    table->cells.clear();
+    size_t sep_begin = header_end + 1;
+    size_t sep_end = line_end(sep_begin);
+    if (!scan_separator(sep_begin, sep_end, table) || !split_row(begin, trimmed, table)) {
+      return false;
+    }
+    size_t body = sep_end < size_ ? sep_end + 1 : size_;
+    size_t pos = body;
+    size_t rows = 0;
+    while (pos < size_) {
+      size_t end = line_end(pos);
+      if (simd::find_byte(data_ + pos, end - pos, '|') == end - pos) {
+        break;
+      }
+      if (data_[pos] != '|' || !split_row(pos, end, table)) {
+        return false;
+      }
+      rows++;
+      pos = end < size_ ? end + 1 : size_;
+    }
+    if (rows < min_rows_) {
+      return false;
+    }
+    // hoedown would skip a byte order mark at the start of the next render
+    if (size_ - pos >= 3 && memcmp(data_ + pos, UTF8_BOM, 3) == 0) {
+      return false;
+    }
+    if (simd::find_first_of(data_ + begin, header_end - begin, inline_chars_) < header_end - begin ||
+        simd::find_first_of(data_ + body, pos - body, inline_chars_) < pos - body) {
+      return false;
+    }
+    table->end = pos;
+    return true;
+  }
+
+  bool PipeTableScanner::next(PipeTable* table) {
+    while (enabled_ && pos_ < size_) {
+      size_t begin = pos_;
+      size_t end = line_end(begin);
+      pos_ = end < size_ ? end + 1 : size_;
+      if (fenced_code_ && !update_fence(begin, end)) {
+        enabled_ = false;
+        break;
+      }
+      if (fence_width_ > 0) {
+        prev_blank_ = false;
+        continue;
+      }
+      // hoedown starts a new block after a blank line, so a table found
+      // there renders the same on its own
+      if (prev_blank_ && data_[begin] == '|' && scan_table(begin, table)) {
+        pos_ = table->end;
+        prev_blank_ = false;
+        return true;
+      }
+      prev_blank_ = true;
+      for (size_t i = begin; i < end; i++) {
+        if (data_[i] != ' ') {
+          prev_blank_ = false;
+          break;
+        }
+      }
+    }
+    return false;
+  }
+
+}
@@ -0,0 +1,248 @@
+// Behaviour checks for the analyzer library, run by make check.
+//
+// Usage: gb_check [case...]
+// Runs every case when none are named. Exits 1 if any case fails.
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "gb_json.hpp"
+#include "gb_slowlog.hpp"
+#include "markdown_analyzer.hpp"
+#include "markdown_parser.hpp"
+#include "parse_profile.hpp"
+
+using namespace greenbar;
+
+struct Case {
+  const char* name;
+  const char* description;
+  bool (*run)();
+};
+
+static std::string render_html(MarkdownParser& parser, const std::string& input) {
+  auto doc = parser.acquire();
+  parser.render(doc, (const uint8_t*) input.data(), input.size(), parser.config().limits);
+  std::string html((const char*) doc->ob->data, doc->ob->size);
+  parser.release(doc);
+  return html;
+}
+
+static bool expect(bool ok, const char* what, const std::string& output) {
+  if (!ok) {
+    printf("  expected %s in:\n%s\n", what, output.c_str());
+  }
+  return ok;
+}
+
+static bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+// Previews show chat and user text, so raw HTML and script links must not
+// survive rendering
+static bool html_escape() {
+  ParserConfig config;
+  config.output = OUTPUT_HTML;
+  MarkdownParser parser(config);
+  auto html = render_html(parser, "<script>alert(1)</script>\n\nHi <img src=x onerror=alert(1)> there\n");
+  bool ok = expect(!contains(html, "<script") && contains(html, "&lt;script"), "an escaped script block", html);
+  ok = expect(!contains(html, "<img"), "an escaped inline tag", html) && ok;
+  html = render_html(parser, "[a](javascript:alert(1)) [b](JavaScript:x) [c](java\tscript:x) [d](http://example.com) "
+                     "[e](docs/page#top)\n");
+  ok = expect(!contains(html, "href=\"java") && !contains(html, "href=\"JavaScript"), "no script links", html) && ok;
+  ok = expect(contains(html, "href=\"http://example.com\"") && contains(html, "href=\"docs/page#top\""),
+              "http and relative links", html) && ok;
+  return ok;
+}
+
+// Body rows of each table fixture, enough for the fast path to take it
+#define TABLE_ROWS (GB_FAST_TABLE_MIN_ROWS + 8)
+
+// Text around a table and the rows it cycles through. Rows may hold one
+// %zu for the row number.
+struct TableFixture {
+  const char* name;
+  const char* before;
+  const char* header;
+  const char* separator;
+  const char* rows[3];
+  const char* after;
+};
+
+static const TableFixture table_fixtures[] = {
+  {"aligned", "", "| a | b | c | d |", "|:--|:-:|--:|---|",
+   {"| one %zu | two | three | four |", "| x | y | z | w |", "|1|2|3|4|"}, ""},
+  {"no outer pipes", "Intro\n\n", "a | b", "--- | :---:",
+   {"x %zu | y", "left|right", "  spaced  |  out  "}, "\nOutro\n"},
+  {"escaped pipes", "", "| a \\| b | c |", "|---|---|",
+   {"| x \\| y | z %zu |", "| plain | text |", "| \\|edge\\| | end |"}, ""},
+  {"inline markup", "", "| a | b |", "|---|---|",
+   {"| row %zu | plain |", "| *em* | **strong** |", "| `code` | [link](http://example.com) |"}, ""},
+  {"plain then inline", "", "| a | b |", "|---|---|",
+   {"| row %zu | plain |", "| more | text |", "| last | row |"}, "| *late* | `markup` |\n"},
+  {"ragged rows", "", "| a | b | c |", "|---|---|---|",
+   {"| one %zu |", "| x | y | z | extra |", "| x | y | z |"}, ""},
+  {"empty cells", "", "| a | b |", "|---|---|",
+   {"| %zu | |", "| | y |", "| x | y |"}, ""},
+  {"after paragraph", "A paragraph right before\n", "| a | b |", "|---|---|",
+   {"| x %zu | y |", "| x | y |", "| x | y |"}, "Text right after\n\n- a list\n"},
+  {"in list", "- item\n\n", "| a | b |", "|---|---|",
+   {"| x %zu | y |", "| x | y |", "| x | y |"}, ""},
+  {"fenced", "```\n| not | a |\n|---|---|\n| table | here |\n```\n\n", "| a | b |", "|---|---|",
+   {"| x %zu | y |", "| x | y |", "| x | y |"}, "\n```\n| also | code |\n"},
+  {NULL, NULL, NULL, NULL, {NULL, NULL, NULL}, NULL}
+};
+
+static std::string build_table(const TableFixture& fixture) {
+  std::string out(fixture.before);
+  out.append(fixture.header).append("\n").append(fixture.separator).append("\n");
+  char row[256];
+  for (size_t i = 0; i < TABLE_ROWS; i++) {
+    snprintf(row, sizeof(row), fixture.rows[i % 3], i);
+    out.append(row).append("\n");
+  }
+  // Twice, so the text after the table is also a second table's lead-in
+  out.append(fixture.after).append(out);
+  return out;
+}
+
+// The tree of input as JSON, rendered either by the parser, which builds
+// large plain tables directly, or by hoedown's callbacks alone
+static std::string tree_json(MarkdownParser& parser, const std::string& input, bool fast, uint64_t* fast_tables) {
+  auto doc = parser.acquire();
+  auto data = (const uint8_t*) input.data();
+  const ParseLimits& limits = parser.config().limits;
+  if (fast) {
+    ParseProfile profile;
+    parser.render(doc, data, input.size(), limits, &profile);
+    *fast_tables += profile.fast_tables;
+  } else {
+    get_limits(doc->analyzer)->reset(limits);
+    hoedown_document_render(doc->document, doc->ob, data, input.size());
+  }
+  doc->ob->size = 0;
+  collector_to_json(doc->ob, get_collector(doc->analyzer), get_limits(doc->analyzer), parser.config());
+  std::string json((const char*) doc->ob->data, doc->ob->size);
+  parser.release(doc);
+  return json;
+}
+
+// Tables built directly must match what hoedown's table callbacks build
+static bool fast_tables() {
+  MarkdownParser parser((ParserConfig()));
+  uint64_t built = 0;
+  bool ok = true;
+  for (size_t i = 0; table_fixtures[i].name != NULL; i++) {
+    auto input = build_table(table_fixtures[i]);
+    auto fast = tree_json(parser, input, true, &built);
+    auto callbacks = tree_json(parser, input, false, &built);
+    if (fast != callbacks) {
+      printf("  %s: trees differ\n  fast path: %s\n  callbacks: %s\n", table_fixtures[i].name, fast.c_str(),
+             callbacks.c_str());
+      ok = false;
+    }
+  }
+  // Otherwise the comparison proves nothing
+  if (built == 0) {
+    printf("  no fixture took the fast path\n");
+    ok = false;
+  }
+  printf("  %" PRIu64 " tables built directly\n", built);
+  return ok;
+}
+
+static std::string json_string(const std::string& text) {
+  hoedown_buffer* out = hoedown_buffer_new(64);
+  put_json_string(out, (const uint8_t*) text.data(), text.size());
+  std::string json((const char*) out->data, out->size);
+  hoedown_buffer_free(out);
+  return json;
+}
+
+// JSON strings escape what they must and stay valid UTF-8 whatever the
+// input bytes. Inputs are long enough to go through the vector scan too.
+static bool json_strings() {
+  static const struct {
+    std::string text;
+    std::string json;
+  } strings[] = {
+    {"say \"hi\" \\ bye", "\"say \\\"hi\\\" \\\\ bye\""},
+    {std::string("tab\tnl\ncr\rnul\0bel\x07", 18), "\"tab\\tnl\\ncr\\rnul\\u0000bel\\u0007\""},
+    {"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 plain ascii after", "\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 plain ascii after\""},
+    {"lone \x80 cut \xe2\x82 over \xc0\xaf sur \xed\xa0\x80 big \xf4\x90\x80\x80 end \xc3",
+     "\"lone \\ufffd cut \\ufffd\\ufffd over \\ufffd\\ufffd sur \\ufffd\\ufffd\\ufffd "
+     "big \\ufffd\\ufffd\\ufffd\\ufffd end \\ufffd\""},
+  };
+  bool ok = true;
+  for (auto& entry : strings) {
+    auto json = json_string(entry.text);
+    ok = expect(json == entry.json, entry.json.c_str(), json) && ok;
+  }
+  return ok;
+}
+
+static SlowParse slow_parse(uint64_t duration_us, int64_t at_ms) {
+  SlowParse entry;
+  entry.duration_us = duration_us;
+  entry.render_us = 0;
+  entry.bytes = 0;
+  entry.nodes = 0;
+  entry.limit = LIMIT_NONE;
+  entry.hash = 1;
+  entry.at_ms = at_ms;
+  return entry;
+}
+
+// Slow parses another instance passes on after an upgrade join the log
+// once, and only if they are among the slowest
+static bool slowlog_merge() {
+  SlowLogConfig config;
+  config.threshold_us = 100;
+  config.capacity = 3;
+  slowlog::restore(config, {slow_parse(300, 1), slow_parse(200, 2)});
+  slowlog::merge({slow_parse(300, 1), slow_parse(50, 3), slow_parse(150, 4), slow_parse(400, 5)});
+  std::vector<SlowParse> kept;
+  slowlog::entries(&kept);
+  std::string found;
+  for (auto& entry : kept) {
+    found += std::to_string(entry.duration_us) + "@" + std::to_string(entry.at_ms) + " ";
+  }
+  return expect(found == "400@5 300@1 200@2 ", "400@5 300@1 200@2", found);
+}
+
+static const Case cases[] = {
+  {"html_escape", "HTML output escapes raw HTML and script links", html_escape},
+  {"fast_tables", "tables built directly match the table callbacks", fast_tables},
+  {"json_strings", "JSON strings are escaped and valid UTF-8", json_strings},
+  {"slowlog_merge", "merged slow parses keep the slowest without duplicates", slowlog_merge},
+  {NULL, NULL, NULL}
+};
+
+int main(int argc, char** argv) {
+  size_t failed = 0;
+  size_t ran = 0;
+  for (size_t i = 0; cases[i].name != NULL; i++) {
+    bool selected = argc == 1;
+    for (int arg = 1; arg < argc; arg++) {
+      selected = selected || strcmp(argv[arg], cases[i].name) == 0;
+    }
+    if (!selected) {
+      continue;
+    }
+    ran++;
+    printf("%s: %s\n", cases[i].name, cases[i].description);
+    bool ok = cases[i].run();
+    printf("  %s\n", ok ? "ok" : "FAIL");
+    if (!ok) {
+      failed++;
+    }
+  }
+  if (ran == 0) {
+    fprintf(stderr, "no such case\n");
+    return 2;
+  }
+  printf("%zu of %zu cases passed\n", ran - failed, ran);
+  return failed == 0 ? 0 : 1;
+}
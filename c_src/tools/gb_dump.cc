@@ -0,0 +1,144 @@
+// Parses Markdown with the standalone analyzer library and prints the node tree.
+//
+// Usage: gb_dump [-q] [-j] [-w] [file ...]
+//   -q  parse only and print nothing, for perf and valgrind runs
+//   -j  print the JSON written by the {output, json} mode
+//   -w  normalize whitespace first, as {normalize_whitespace, true} does
+// Reads stdin when no files are given.
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "gb_json.hpp"
+#include "markdown_analyzer.hpp"
+#include "markdown_parser.hpp"
+#include "md_node.hpp"
+
+using namespace greenbar;
+using namespace greenbar::node2;
+
+static const char* alignment_name(int alignment) {
+  switch(alignment) {
+  case ALIGN_LEFT:
+    return "left";
+  case ALIGN_RIGHT:
+    return "right";
+  case ALIGN_CENTER:
+    return "center";
+  default:
+    return "none";
+  }
+}
+
+static const char* limit_name(LimitType which) {
+  switch(which) {
+  case LIMIT_INPUT_SIZE:
+    return "input_size";
+  case LIMIT_NODES:
+    return "nodes";
+  case LIMIT_NESTING:
+    return "nesting";
+  default:
+    return "timeout";
+  }
+}
+
+static void print_node(std::ostream& out, MarkdownNode* node, int indent) {
+  out << std::string(indent * 2, ' ') << type_to_string(node->get_type());
+  if (!node->get_text().empty()) {
+    out << " \"" << node->get_text() << "\"";
+  }
+  if (node->has_attribute(ATTR_LEVEL)) {
+    out << " level=" << node->get_attribute(ATTR_LEVEL).n();
+  }
+  if (node->has_attribute(ATTR_URL)) {
+    out << " url=\"" << node->get_attribute(ATTR_URL).s() << "\"";
+  }
+  if (node->has_attribute(ATTR_ALIGNMENT)) {
+    out << " alignment=" << alignment_name(node->get_attribute(ATTR_ALIGNMENT).n());
+  }
+  if (node->line_terminator()) {
+    out << " eol";
+  }
+  out << "\n";
+  auto container = dynamic_cast<MarkdownNodeContainer*>(node);
+  if (container == nullptr) {
+    return;
+  }
+  // Children are stored last to first
+  auto& children = container->get_children();
+  for (auto iter = children.rbegin(); iter != children.rend(); ++iter) {
+    print_node(out, *iter, indent + 1);
+  }
+}
+
+static bool dump(MarkdownParser& parser, const std::string& name, const std::string& text, bool quiet, bool json) {
+  auto doc = parser.acquire();
+  if (doc == nullptr) {
+    std::cerr << name << ": out of memory\n";
+    return false;
+  }
+  parser.render(doc, (const uint8_t*) text.data(), text.size(), parser.config().limits);
+  auto tracker = get_limits(doc->analyzer);
+  bool ok = !tracker->exceeded();
+  if (!ok) {
+    std::cerr << name << ": limit exceeded: " << limit_name(tracker->which()) << "\n";
+  } else if (json) {
+    doc->ob->size = 0;
+    ok = collector_to_json(doc->ob, get_collector(doc->analyzer), tracker, parser.config());
+    if (ok && !quiet) {
+      std::cout.write((const char*) doc->ob->data, doc->ob->size);
+      std::cout << "\n";
+    }
+  } else if (!quiet) {
+    for (auto node : *get_collector(doc->analyzer)) {
+      print_node(std::cout, node, 0);
+    }
+  }
+  parser.release(doc);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  bool quiet = false;
+  bool json = false;
+  ParserConfig config;
+  int first = 1;
+  for (; first < argc; first++) {
+    if (strcmp(argv[first], "-q") == 0) {
+      quiet = true;
+    } else if (strcmp(argv[first], "-j") == 0) {
+      json = true;
+    } else if (strcmp(argv[first], "-w") == 0) {
+      config.normalize_whitespace = true;
+    } else {
+      break;
+    }
+  }
+  MarkdownParser parser(config);
+  int status = 0;
+  if (first == argc) {
+    std::stringstream buf;
+    buf << std::cin.rdbuf();
+    return dump(parser, "stdin", buf.str(), quiet, json) ? 0 : 1;
+  }
+  for (int i = first; i < argc; i++) {
+    std::ifstream in(argv[i], std::ios::in | std::ios::binary);
+    if (!in) {
+      std::cerr << argv[i] << ": cannot open\n";
+      status = 1;
+      continue;
+    }
+    std::stringstream buf;
+    buf << in.rdbuf();
+    if (argc - first > 1 && !quiet) {
+      std::cout << "== " << argv[i] << "\n";
+    }
+    if (!dump(parser, argv[i], buf.str(), quiet, json)) {
+      status = 1;
+    }
+  }
+  return status;
+}
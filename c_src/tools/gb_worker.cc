@@ -0,0 +1,319 @@
+// Parses Markdown for greenbar_markdown_worker outside the VM.
+//
+// Usage: gb_worker [-e ext,...] [-o tree|html|json] [-t tree|columnar] [-b rows] [-w]
+//                  [-i bytes] [-n nodes] [-d depth] [-T ms] segment
+//   -e  extensions, as the extensions option names them
+//   -o  output, -t tables, -b table_batch_size, -w normalize_whitespace
+//   -i  max_input_size, -n max_nodes, -d max_nesting, -T timeout
+//
+// Requests and results live in the shared memory segment made by
+// ring_new/1. The port only carries {packet, 4} notifications: any frame
+// from the VM means new requests are waiting, and each result is followed
+// by a frame holding its 8 byte request id. Results are the terms of
+// analyze/2 in external term format. The worker exits when the port closes.
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "gb_etf.hpp"
+#include "gb_json.hpp"
+#include "gb_memory.hpp"
+#include "gb_ring.hpp"
+#include "markdown_analyzer.hpp"
+#include "markdown_parser.hpp"
+
+using namespace greenbar;
+
+// Initial size of the result buffer
+#define OUTPUT_UNIT 4096
+
+// Milliseconds between checks while the response ring is full
+#define FULL_WAIT_MS 1
+
+struct Worker {
+  MarkdownParser* parser;
+  RingSegment segment;
+  hoedown_buffer* out;
+};
+
+static bool read_full(int fd, uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t count = read(fd, data, size);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    data += count;
+    size -= count;
+  }
+  return true;
+}
+
+static bool write_full(int fd, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t count = write(fd, data, size);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    data += count;
+    size -= count;
+  }
+  return true;
+}
+
+// Waits for a notification and discards it. False once the port is closed.
+static bool read_frame() {
+  uint8_t header[4];
+  if (!read_full(STDIN_FILENO, header, sizeof(header))) {
+    return false;
+  }
+  size_t size = ((size_t) header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+  uint8_t scratch[64];
+  while (size > 0) {
+    size_t count = size < sizeof(scratch) ? size : sizeof(scratch);
+    if (!read_full(STDIN_FILENO, scratch, count)) {
+      return false;
+    }
+    size -= count;
+  }
+  return true;
+}
+
+static bool notify(uint64_t id) {
+  uint8_t frame[12] = {0, 0, 0, 8};
+  for (int i = 0; i < 8; i++) {
+    frame[4 + i] = (uint8_t) (id >> (56 - 8 * i));
+  }
+  return write_full(STDOUT_FILENO, frame, sizeof(frame));
+}
+
+// Gives the VM time to take results. False once the port is closed.
+static bool wait_for_space() {
+  struct pollfd port = {STDIN_FILENO, 0, 0};
+  return !(poll(&port, 1, FULL_WAIT_MS) > 0 && (port.revents & (POLLHUP | POLLERR)));
+}
+
+// Writes the term analyze/2 would return for text into the worker's
+// output. The request is released as soon as hoedown is done with it.
+static void parse_request(Worker& worker, const uint8_t* text, size_t size) {
+  const ParserConfig& config = worker.parser->config();
+  hoedown_buffer* out = worker.out;
+  out->size = 0;
+  etf::put_version(out);
+  if (config.limits.max_input_size > 0 && size > config.limits.max_input_size) {
+    worker.segment.requests.release();
+    etf::put_limit_error(out, LIMIT_INPUT_SIZE);
+    return;
+  }
+  auto doc = worker.parser->acquire();
+  if (doc == nullptr) {
+    worker.segment.requests.release();
+    etf::put_atom(out, "out of memory");
+    return;
+  }
+  worker.parser->render(doc, text, size, config.limits);
+  worker.segment.requests.release();
+  if (doc->analyzer == nullptr) {
+    etf::put_tuple(out, 2);
+    etf::put_atom(out, "ok");
+    etf::put_binary(out, doc->ob->data, doc->ob->size);
+    worker.parser->release(doc);
+    return;
+  }
+  auto tracker = get_limits(doc->analyzer);
+  auto collector = get_collector(doc->analyzer);
+  bool ok = !tracker->exceeded();
+  if (ok && config.output == OUTPUT_JSON) {
+    doc->ob->size = 0;
+    ok = collector_to_json(doc->ob, collector, tracker, config);
+    if (ok) {
+      etf::put_tuple(out, 2);
+      etf::put_atom(out, "ok");
+      etf::put_binary(out, doc->ob->data, doc->ob->size);
+    }
+  } else if (ok) {
+    etf::put_tuple(out, 2);
+    etf::put_atom(out, "ok");
+    ok = collector_to_etf(out, collector, tracker, config);
+  }
+  if (!ok) {
+    out->size = 1;
+    etf::put_limit_error(out, tracker->which());
+  }
+  worker.parser->release(doc);
+}
+
+// Publishes the worker's output as the result of request id
+static bool respond(Worker& worker, uint64_t id) {
+  SharedRing& responses = worker.segment.responses;
+  hoedown_buffer* out = worker.out;
+  if (out->size > responses.max_payload()) {
+    out->size = 1;
+    etf::put_tuple(out, 2);
+    etf::put_atom(out, "error");
+    etf::put_atom(out, "result_too_large");
+  }
+  uint8_t* payload;
+  while ((payload = responses.reserve(out->size)) == nullptr) {
+    if (!wait_for_space()) {
+      return false;
+    }
+  }
+  memcpy(payload, out->data, out->size);
+  responses.commit(out->size, id);
+  return notify(id);
+}
+
+// Answers every waiting request. False once the port is closed.
+static bool drain(Worker& worker) {
+  RingRecord record;
+  const uint8_t* text;
+  while (worker.segment.requests.peek(&record, &text)) {
+    // Nodes of small inputs come from the arena, as in the NIF
+    bool small = record.size <= GB_SMALL_INPUT;
+    if (small) {
+      memory::begin_arena();
+    }
+    parse_request(worker, text, record.size);
+    if (small) {
+      memory::end_arena();
+    }
+    if (!respond(worker, record.id)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool parse_count(const char* text, unsigned long* value) {
+  char* end;
+  errno = 0;
+  *value = strtoul(text, &end, 10);
+  return end != text && *end == '\0' && errno == 0;
+}
+
+static bool parse_extensions(const char* names, unsigned int* extensions) {
+  std::string list(names);
+  unsigned int flags = 0;
+  size_t start = 0;
+  while (start < list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    unsigned int flag;
+    if (!extension_flag(list.substr(start, end - start).c_str(), &flag)) {
+      return false;
+    }
+    flags |= flag;
+    start = end + 1;
+  }
+  *extensions = flags;
+  return true;
+}
+
+static bool parse_option(char flag, const char* value, ParserConfig* config) {
+  unsigned long count = 0;
+  switch(flag) {
+  case 'e':
+    return parse_extensions(value, &config->extensions);
+  case 'o':
+    if (strcmp(value, "tree") == 0) {
+      config->output = OUTPUT_TREE;
+    } else if (strcmp(value, "html") == 0) {
+      config->output = OUTPUT_HTML;
+    } else if (strcmp(value, "json") == 0) {
+      config->output = OUTPUT_JSON;
+    } else {
+      return false;
+    }
+    return true;
+  case 't':
+    if (strcmp(value, "tree") == 0) {
+      config->tables = TABLES_TREE;
+    } else if (strcmp(value, "columnar") == 0) {
+      config->tables = TABLES_COLUMNAR;
+    } else {
+      return false;
+    }
+    return true;
+  default:
+    break;
+  }
+  if (!parse_count(value, &count)) {
+    return false;
+  }
+  switch(flag) {
+  case 'b':
+    config->table_batch_size = count;
+    break;
+  case 'i':
+    config->limits.max_input_size = count;
+    break;
+  case 'n':
+    config->limits.max_nodes = count;
+    break;
+  case 'd':
+    config->limits.max_nesting = count;
+    break;
+  case 'T':
+    config->limits.timeout_ms = count;
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  ParserConfig config;
+  // One request is parsed at a time
+  config.pool_size = 1;
+  int i = 1;
+  for (; i < argc - 1 && argv[i][0] == '-' && strlen(argv[i]) == 2; i++) {
+    char flag = argv[i][1];
+    if (flag == 'w') {
+      config.normalize_whitespace = true;
+    } else if (i + 1 == argc - 1 || !parse_option(flag, argv[i + 1], &config)) {
+      std::cerr << "gb_worker: bad option " << argv[i] << "\n";
+      return 2;
+    } else {
+      i++;
+    }
+  }
+  if (i != argc - 1) {
+    std::cerr << "usage: gb_worker [options] segment\n";
+    return 2;
+  }
+  // As in the NIF, HTML rendering can't enforce these
+  if (config.output == OUTPUT_HTML && (config.limits.max_nodes > 0 || config.limits.timeout_ms > 0)) {
+    std::cerr << "gb_worker: -n and -T don't apply to -o html\n";
+    return 2;
+  }
+  // A closed port shows up as a failed write instead
+  signal(SIGPIPE, SIG_IGN);
+  Worker worker;
+  int error = ring::attach(argv[i], &worker.segment);
+  if (error != 0) {
+    std::cerr << "gb_worker: " << argv[i] << ": " << strerror(error) << "\n";
+    return 1;
+  }
+  MarkdownParser parser(config);
+  worker.parser = &parser;
+  worker.out = hoedown_buffer_new(OUTPUT_UNIT);
+  while (read_frame() && drain(worker)) {
+  }
+  hoedown_buffer_free(worker.out);
+  ring::unmap(&worker.segment);
+  return 0;
+}
@@ -2,7 +2,23 @@
 
 -export([init/0,
          analyze/1,
-         parse/1]).
+         analyze/2,
+         analyze_stream/3,
+         analyze_file/1,
+         analyze_file/2,
+         parse/1,
+         parse/2,
+         new_parser/1,
+         parse_profile/1,
+         stats/0,
+         slow_parses/0,
+         configure_slow_parses/1]).
+
+%% Used by greenbar_markdown_worker
+-export([worker_path/0,
+         ring_new/1,
+         ring_submit/3,
+         ring_take/1]).
 
 -on_load(init/0).
 
@@ -16,9 +32,9 @@ init() ->
       Error
   end.
 
-analyze(Text) when is_list(Text) ->
-  analyze(iolist_to_binary(Text));
-analyze(Text) when is_binary(Text) ->
+%% Text may be any iodata. The NIF reads binaries in place and gathers
+%% iolists natively, so there is no need to flatten them first.
+analyze(Text) ->
   case parse(Text) of
     {ok, []} ->
       {ok, []};
@@ -28,27 +44,224 @@ analyze(Text) when is_binary(Text) ->
       Error
   end.
 
+%% Options limit the work done on untrusted input:
+%%   {max_input_size, Bytes} | {max_nodes, N} | {max_nesting, Depth} | {timeout, Ms}
+%% Exceeding any of them returns {error, limit_exceeded, Which} where Which is
+%% one of input_size, nodes, nesting or timeout. hoedown itself never
+%% nests more than about 32 levels, to stay within the scheduler stack, so
+%% deeper markup is left as text whatever max_nesting allows.
+%% The first argument may also be a parser returned by new_parser/1.
+%% With {output, html} or {output, json} the result is {ok, Binary}.
+analyze(First, Second) ->
+  case parse(First, Second) of
+    {ok, Html} when is_binary(Html) ->
+      {ok, Html};
+    {ok, []} ->
+      {ok, []};
+    {ok, Values} ->
+      {ok, lists:reverse(Values)};
+    Error ->
+      Error
+  end.
+
+%% Parses Text with the options of analyze/2 and sends the result to Pid a
+%% top-level node at a time, so Pid can use the first ones while the rest
+%% is still being parsed:
+%%   {greenbar_block, Ref, Node}  one per node, in the order analyze/2
+%%                                returns them
+%%   {greenbar_done, Ref, Result} after the last node
+%% Result is ok or an error of analyze/2, in which case the nodes already
+%% sent are incomplete. A node goes out once a later paragraph makes it
+%% final; the nodes after the second to last paragraph are sent at the end.
+%% The caller is busy parsing until the end, so Pid must be another
+%% process; self() fails with badarg. The parse runs on a dirty CPU
+%% scheduler where the VM has them.
+%% Returns {ok, Ref} when the parse finished or Result when it didn't.
+%% Only {output, tree} is supported.
+analyze_stream(Text, Pid, Options) ->
+  Ref = make_ref(),
+  case stream(Text, Options, Pid, Ref) of
+    ok ->
+      {ok, Ref};
+    Error ->
+      Error
+  end.
+
+analyze_file(Path) ->
+  analyze_file(Path, []).
+
+%% Like analyze/2 on the contents of the file at Path, read natively on a
+%% dirty IO scheduler into a pooled buffer instead of into a binary.
+%% max_input_size is checked against the file size before reading. Returns
+%% {error, Reason} with a file error such as enoent or eacces when the file
+%% can't be read. Also accepts
+%%   {mmap, true}  parse the file in place from a memory mapping, saving
+%%       the copy. Only for files nothing rewrites while they are parsed:
+%%       truncating a mapped file makes the next read past its new end
+%%       raise SIGBUS, which kills the whole node.
+analyze_file(Path, Options) ->
+  Name = unicode:characters_to_binary(Path, unicode, file:native_name_encoding()),
+  {Map, ParseOptions} = case lists:keytake(mmap, 1, Options) of
+                          {value, {mmap, Value}, Rest} -> {Value, Rest};
+                          false -> {false, Options}
+                        end,
+  case parse_file(Name, Map, ParseOptions) of
+    {ok, Html} when is_binary(Html) ->
+      {ok, Html};
+    {ok, []} ->
+      {ok, []};
+    {ok, Values} ->
+      {ok, lists:reverse(Values)};
+    Error ->
+      Error
+  end.
+
 parse(_Text) -> ?nif_error.
 
+%% Like analyze/1 but also returns {ok, Values, Profile} where Profile shows
+%% where a slow document spends its time:
+%%   #{render_us => N, convert_us => N,
+%%     callbacks => #{paragraph => N, normal_text => N, ...},
+%%     fast_tables => N, nodes => #{NodeName => N},
+%%     max_depth => N, max_collector => N,
+%%     allocations => N, bytes_allocated => N, peak_bytes => N}
+%% Allocations are those made while rendering; peak_bytes covers the
+%% whole call.
+parse_profile(Text) ->
+  case profile(Text) of
+    {ok, Values, Profile} ->
+      {ok, lists:reverse(Values), Profile};
+    Error ->
+      Error
+  end.
+
+parse({greenbar_parser, Parser}, Text) ->
+  parse_with_parser(Parser, Text);
+parse(Text, Options) ->
+  parse_with_options(Text, Options).
+
+%% Creates a reusable parser. Accepts the limit options of analyze/2 plus
+%%   {extensions, [tables | fenced_code | autolink | strikethrough |
+%%                 no_intra_emphasis | space_headers | math_explicit |
+%%                 disable_indented_code]}
+%%   {output, tree | html | json}  html renders the whole document with
+%%       hoedown's HTML renderer into one binary, for previews. Raw HTML
+%%       is escaped, and links to schemes other than http, https, ftp and
+%%       mailto are left as text. Only max_input_size and max_nesting
+%%       apply; nesting beyond the limit is left unrendered. Combining it
+%%       with a non-zero max_nodes or timeout fails with badarg, as the
+%%       HTML renderer can't enforce them. json writes
+%%       the result of analyze/2 as one JSON binary: maps become objects,
+%%       atoms strings and tuples arrays. Bytes of text that aren't valid
+%%       UTF-8 become U+FFFD.
+%%   {tables, tree | columnar}  columnar returns plain text tables as
+%%       #{name => table, header => [Text], alignments => [Align],
+%%         rows => [{Text, ...}]}
+%%   {table_batch_size, N}  groups columnar rows as row_batches => [[Row]]
+%%   {intern_strings, true}  builds each distinct text of up to 256 bytes
+%%       once and shares it between nodes, shrinking results of repetitive
+%%       tables and link lists
+%%   {normalize_whitespace, true}  before parsing, turns CRLF into LF,
+%%       strips trailing spaces and tabs (keeping the two that make a hard
+%%       break) and cuts runs of blank lines to one, outside fenced code.
+%%       Saves work and newline nodes on generated templates. analyze/2
+%%       with this option builds a fresh document each call, so create a
+%%       parser when using it repeatedly.
+%%   {page_bytes, N}  adds pages => [Binary] to fixed_width_block nodes:
+%%       the text split after the last newline that keeps each page within
+%%       N bytes, or at N bytes on a character boundary for longer lines.
+%%       Pages are sub-binaries of text, so they share its memory.
+%%       Tree output only.
+%%   {pool_size, N}  maximum number of idle documents kept ready
+%% Parsers survive a code upgrade of the NIF and are rebuilt by the new
+%% version on their first use.
+new_parser(_Options) -> ?nif_error.
+
+%% Cumulative counters since the NIF was first loaded, carried over code
+%% upgrades:
+%%   #{calls => N, input_bytes => N, errors => N,
+%%     nodes => #{NodeName => N},
+%%     limits => #{input_size => N, nodes => N, nesting => N, timeout => N},
+%%     pool => #{hits => N, misses => N},
+%%     parse_us => Histogram, convert_us => Histogram, peak_kb => Histogram,
+%%     memory => #{current => Bytes, peak => Bytes, allocated => Bytes,
+%%                 allocations => N, largest_call_peak => Bytes}}
+%% Histograms are [{UpperBound, Count}] with power of two bounds, the last
+%% bound being infinity. Counts are kept per scheduler and summed here.
+%% memory counts parsers, their pooled documents, analyzer state and nodes,
+%% plus hoedown's buffers where the build could redirect hoedown's malloc.
+%% Short-lived scratch space of term conversion isn't counted. Counted
+%% memory is allocated with enif_alloc, so it is also part of
+%% erlang:memory(system). Its current and peak may trail by 64KB per
+%% scheduler.
+stats() -> ?nif_error.
+
+%% The slowest parses that took at least the slow parse threshold since the
+%% log was last configured, slowest first:
+%%   [#{duration_us => N, render_us => N, input_bytes => N, nodes => N,
+%%      limit => none | input_size | nodes | nesting | timeout,
+%%      hash => FNV1a64, at_ms => EpochMs, sample => Binary}]
+%% hash covers the whole input so repeated offenders can be matched up.
+%% sample, the first bytes of the input, is only kept when sample_bytes is
+%% set.
+slow_parses() -> ?nif_error.
+
+%% Changes how slow parses are kept and clears the ones kept so far.
+%% Options not given keep their current values:
+%%   {threshold_us, N}  keep parses taking at least N us, 0 to stop, default 10000
+%%   {capacity, N}      number kept, default 32. Once full a slower parse
+%%                      replaces the fastest one kept
+%%   {sample_bytes, N}  leading input bytes kept, up to 4096, default 0
+configure_slow_parses(_Options) -> ?nif_error.
+
+parse_with_options(_Text, _Options) -> ?nif_error.
+
+parse_with_parser(_Parser, _Text) -> ?nif_error.
+
+profile(_Text) -> ?nif_error.
+
+stream(_Text, _Options, _Pid, _Ref) -> ?nif_error.
+
+parse_file(_Path, _Map, _Options) -> ?nif_error.
+
+%% Location of the gb_worker executable, next to the NIF
+worker_path() ->
+  priv_path("gb_worker").
+
+%% Creates the shared memory of a worker with two rings of RingBytes each.
+%% Returns {ok, Ring, Name} where Name is passed to gb_worker.
+ring_new(_RingBytes) -> ?nif_error.
+
+%% Copies Text into the request ring as request Id. Returns ok, full when
+%% the worker has yet to make room, or {error, limit_exceeded, input_size}
+%% when Text is more than half the ring.
+ring_submit(_Ring, _Id, _Text) -> ?nif_error.
+
+%% Returns {Id, Result} for the oldest finished request, Result being the
+%% external term format of its analyze/2 result, or empty.
+ring_take(_Ring) -> ?nif_error.
+
 build_nif_path() ->
+  priv_path("greenbar_markdown").
+
+priv_path(Name) ->
   case escript_path() of
     undefined ->
       case code:priv_dir(greenbar_markdown) of
         Path when is_list(Path) ->
-          {ok, filename:join([Path, "greenbar_markdown"])};
+          {ok, filename:join([Path, Name])};
         {error, bad_name} ->
           case code:which(?MODULE) of
             Filename when is_list(Filename) ->
               {ok, filename:join([filename:dirname(Filename),
                                   "..","priv",
-                                  "greenbar_markdown"])};
+                                  Name])};
             Reason when is_atom(Reason) ->
               {error, Reason}
           end
       end;
     EscriptPath ->
-      SharedLibPath = filename:join([EscriptPath, "greenbar_markdown"]),
-      {ok, SharedLibPath}
+      {ok, filename:join([EscriptPath, Name])}
   end.
 
 escript_path() ->
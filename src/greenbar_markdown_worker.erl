@@ -0,0 +1,226 @@
+-module(greenbar_markdown_worker).
+
+%% Parses Markdown in a separate gb_worker OS process instead of inside
+%% the VM, so a crash or runaway parse can't take the node down and
+%% parsing runs on its own cores. Text and results are exchanged through
+%% shared memory; the port only carries short notifications. Results are
+%% encoded by the worker and decoded by the caller, so the server only
+%% passes binaries along.
+
+-behaviour(gen_server).
+
+-export([start_link/0,
+         start_link/1,
+         analyze/2,
+         analyze/3,
+         stop/1]).
+
+-export([init/1,
+         handle_call/3,
+         handle_cast/2,
+         handle_info/2,
+         terminate/2,
+         code_change/3]).
+
+-define(DEFAULT_RING_BYTES, 8388608).
+-define(DEFAULT_TIMEOUT, 5000).
+
+%% Atoms only gb_worker sends. The NIF makes every other atom of a result
+%% when it loads, so all of them exist for safe decoding.
+-define(WORKER_ATOMS, ["result_too_large"]).
+
+%% Any frame tells the worker new requests are waiting
+-define(REQUESTS_READY, <<"r">>).
+
+%% Parser options passed to gb_worker as flags
+-define(COUNT_FLAGS, [{table_batch_size, "-b"},
+                      {max_input_size, "-i"},
+                      {max_nodes, "-n"},
+                      {max_nesting, "-d"},
+                      {timeout, "-T"}]).
+
+%% pending maps request ids to callers, waiting holds requests the ring
+%% had no room for yet
+-record(state, {port, ring, next_id = 0, pending = #{}, waiting = queue:new()}).
+
+start_link() ->
+  start_link([]).
+
+%% Options are those of greenbar_markdown:new_parser/1 and apply to every
+%% request, plus
+%%   {ring_bytes, N}  size of the request ring and of the response ring,
+%%       default 8MB. Inputs and encoded results may each take up to half
+%%       a ring. Larger inputs return {error, limit_exceeded, input_size},
+%%       larger results {error, result_too_large}. Results of tables take
+%%       around ten times their input.
+%% page_bytes isn't supported. intern_strings and pool_size have no effect
+%% in the worker and are ignored.
+start_link(Options) ->
+  gen_server:start_link(?MODULE, Options, []).
+
+analyze(Worker, Text) ->
+  analyze(Worker, Text, ?DEFAULT_TIMEOUT).
+
+%% Returns what greenbar_markdown:analyze/2 would with the worker's
+%% options, or {error, {worker_exit, Status}} if the worker died first.
+%% A result that doesn't decode to existing atoms and plain terms returns
+%% {error, bad_result}.
+%% Statistics and slow parses of the worker aren't part of
+%% greenbar_markdown:stats/0 and slow_parses/0.
+analyze(Worker, Text, Timeout) ->
+  %% Bad text fails here with badarg rather than in the server
+  _ = iolist_size(Text),
+  case gen_server:call(Worker, {analyze, Text}, Timeout) of
+    {result, Result} ->
+      decode(Result);
+    Error ->
+      Error
+  end.
+
+stop(Worker) ->
+  gen_server:stop(Worker).
+
+init(Options) ->
+  _ = [list_to_atom(Name) || Name <- ?WORKER_ATOMS],
+  RingBytes = proplists:get_value(ring_bytes, Options, ?DEFAULT_RING_BYTES),
+  case worker_args(proplists:delete(ring_bytes, Options), []) of
+    {ok, Args} ->
+      case html_limits(Options) of
+        [] ->
+          start_worker(RingBytes, Args);
+        [Option | _] ->
+          {stop, {error, {badarg, Option}}}
+      end;
+    Error ->
+      {stop, Error}
+  end.
+
+handle_call({analyze, Text}, From, #state{next_id = Id, waiting = Waiting} = State) ->
+  State1 = State#state{next_id = Id + 1, waiting = queue:in({Id, Text, From}, Waiting)},
+  {noreply, submit_waiting(State1, false)};
+handle_call(_Request, _From, State) ->
+  {reply, {error, badarg}, State}.
+
+handle_cast(_Request, State) ->
+  {noreply, State}.
+
+%% Each notification means at least one result is ready. Taking results
+%% frees request space too, as the worker is done with their input.
+handle_info({Port, {data, _Id}}, #state{port = Port} = State) ->
+  {noreply, submit_waiting(take_results(State), false)};
+handle_info({Port, {exit_status, Status}}, #state{port = Port} = State) ->
+  Error = {error, {worker_exit, Status}},
+  [gen_server:reply(From, Error) || From <- maps:values(State#state.pending)],
+  [gen_server:reply(From, Error) || {_Id, _Text, From} <- queue:to_list(State#state.waiting)],
+  {stop, {worker_exit, Status}, State#state{port = undefined, pending = #{}, waiting = queue:new()}};
+handle_info(_Info, State) ->
+  {noreply, State}.
+
+terminate(_Reason, #state{port = undefined}) ->
+  ok;
+terminate(_Reason, #state{port = Port}) ->
+  catch port_close(Port),
+  ok.
+
+code_change(_OldVsn, State, _Extra) ->
+  {ok, State}.
+
+%% The worker runs outside the VM to contain faults, so what it sends
+%% can't be trusted to be well formed or to stick to known atoms
+decode(Result) ->
+  try
+    binary_to_term(Result, [safe])
+  catch
+    error:badarg ->
+      {error, bad_result}
+  end.
+
+start_worker(RingBytes, Args) ->
+  case greenbar_markdown:worker_path() of
+    {ok, Path} ->
+      case greenbar_markdown:ring_new(RingBytes) of
+        {ok, Ring, Name} ->
+          Port = open_port({spawn_executable, Path},
+                           [{args, Args ++ [binary_to_list(Name)]}, {packet, 4}, binary, exit_status]),
+          {ok, #state{port = Port, ring = Ring}};
+        Error ->
+          {stop, Error}
+      end;
+    Error ->
+      {stop, Error}
+  end.
+
+%% Moves waiting requests into the ring while there is room, then wakes
+%% the worker once for all of them
+submit_waiting(#state{port = Port, ring = Ring, pending = Pending, waiting = Waiting} = State, Submitted) ->
+  case queue:out(Waiting) of
+    {{value, {Id, Text, From}}, Rest} ->
+      case greenbar_markdown:ring_submit(Ring, Id, Text) of
+        ok ->
+          submit_waiting(State#state{pending = maps:put(Id, From, Pending), waiting = Rest}, true);
+        full ->
+          notify(Port, Submitted),
+          State;
+        Error ->
+          gen_server:reply(From, Error),
+          submit_waiting(State#state{waiting = Rest}, Submitted)
+      end;
+    {empty, _} ->
+      notify(Port, Submitted),
+      State
+  end.
+
+notify(Port, true) ->
+  port_command(Port, ?REQUESTS_READY);
+notify(_Port, false) ->
+  ok.
+
+take_results(#state{ring = Ring, pending = Pending} = State) ->
+  case greenbar_markdown:ring_take(Ring) of
+    {Id, Result} when is_binary(Result) ->
+      case maps:find(Id, Pending) of
+        {ok, From} ->
+          gen_server:reply(From, {result, Result}),
+          take_results(State#state{pending = maps:remove(Id, Pending)});
+        error ->
+          take_results(State)
+      end;
+    _ ->
+      State
+  end.
+
+%% Limits given with {output, html}, which can't enforce them. The last
+%% output option counts, as in the NIF.
+html_limits(Options) ->
+  case lists:reverse(proplists:get_all_values(output, Options)) of
+    [html | _] ->
+      [Option || {Name, N} = Option <- Options, Name =:= max_nodes orelse Name =:= timeout, N =/= 0];
+    _ ->
+      []
+  end.
+
+worker_args([], Args) ->
+  {ok, lists:append(lists:reverse(Args))};
+worker_args([{extensions, Names} | Options], Args) when is_list(Names) ->
+  worker_args(Options, [["-e", string:join([atom_to_list(Name) || Name <- Names], ",")] | Args]);
+worker_args([{output, Output} | Options], Args) when Output =:= tree; Output =:= html; Output =:= json ->
+  worker_args(Options, [["-o", atom_to_list(Output)] | Args]);
+worker_args([{tables, Tables} | Options], Args) when Tables =:= tree; Tables =:= columnar ->
+  worker_args(Options, [["-t", atom_to_list(Tables)] | Args]);
+worker_args([{normalize_whitespace, true} | Options], Args) ->
+  worker_args(Options, [["-w"] | Args]);
+worker_args([{normalize_whitespace, false} | Options], Args) ->
+  worker_args(Options, Args);
+worker_args([{intern_strings, Value} | Options], Args) when is_boolean(Value) ->
+  worker_args(Options, Args);
+worker_args([{pool_size, N} | Options], Args) when is_integer(N), N >= 0 ->
+  worker_args(Options, Args);
+worker_args([{Name, N} = Option | Options], Args) when is_integer(N), N >= 0 ->
+  case lists:keyfind(Name, 1, ?COUNT_FLAGS) of
+    {Name, Flag} ->
+      worker_args(Options, [[Flag, integer_to_list(N)] | Args]);
+    false ->
+      {error, {badarg, Option}}
+  end;
+worker_args([Option | _], _Args) ->
+  {error, {badarg, Option}}.
@@ -0,0 +1,58 @@
+-module(greenbar_markdown_arena_tests).
+
+%% Inputs of up to 1024 bytes are parsed with nodes from a per-call arena.
+%% analyze_file/2 never uses it, so the two must build the same trees.
+
+-include_lib("eunit/include/eunit.hrl").
+
+-define(SMALL_INPUT, 1024).
+
+documents() ->
+  Dense = iolist_to_binary(lists:duplicate(60, "*a* `b` ")),
+  [<<"x">>,
+   <<"# Title\n\nSome *text* and a [link](http://example.com)\n\n- one\n- two\n">>,
+   <<"| a | b |\n|---|---|\n| 1 | *2* |\n\n```\ncode\n```\n\n> quoted **bold**\n">>,
+   Dense,
+   pad(?SMALL_INPUT),
+   pad(?SMALL_INPUT + 1)].
+
+%% A paragraph document of exactly Size bytes
+pad(Size) ->
+  Line = <<"Some *words* here\n\n">>,
+  Lines = iolist_to_binary(lists:duplicate(Size div byte_size(Line), Line)),
+  <<Lines/binary, (binary:copy(<<"z">>, Size - byte_size(Lines)))/binary>>.
+
+with_file(Content, Fun) ->
+  Path = filename:join("/tmp", "greenbar_arena_" ++ integer_to_list(erlang:unique_integer([positive])) ++ ".md"),
+  ok = file:write_file(Path, Content),
+  try
+    Fun(Path)
+  after
+    file:delete(Path)
+  end.
+
+same_tree_test_() ->
+  [{integer_to_list(byte_size(Doc)),
+    fun() ->
+        with_file(Doc, fun(Path) ->
+                           ?assertEqual(greenbar_markdown:analyze_file(Path, Options),
+                                        greenbar_markdown:analyze(Doc, Options))
+                       end)
+    end} || Doc <- documents(), Options <- [[], [{tables, columnar}], [{intern_strings, true}]]].
+
+pad_test() ->
+  ?assertEqual(?SMALL_INPUT, byte_size(pad(?SMALL_INPUT))).
+
+%% Nothing from one call's arena shows up in the next
+repeated_test() ->
+  Results = [greenbar_markdown:analyze(Doc) || Doc <- documents()],
+  lists:foreach(fun(_) ->
+                    ?assertEqual(Results, [greenbar_markdown:analyze(Doc) || Doc <- documents()])
+                end, lists:seq(1, 20)).
+
+%% A limit hit part way through releases the arena for the next call
+limit_test() ->
+  Doc = lists:nth(4, documents()),
+  Expected = greenbar_markdown:analyze(Doc),
+  ?assertEqual({error, limit_exceeded, nodes}, greenbar_markdown:analyze(Doc, [{max_nodes, 5}])),
+  ?assertEqual(Expected, greenbar_markdown:analyze(Doc)).
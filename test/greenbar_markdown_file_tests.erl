@@ -0,0 +1,74 @@
+-module(greenbar_markdown_file_tests).
+
+%% analyze_file/2 returns what analyze/2 does for the file's contents,
+%% whether read or mapped, and reports files it can't parse.
+
+-include_lib("eunit/include/eunit.hrl").
+
+documents() ->
+  [<<>>,
+   <<"# Title\n\nSome *text* and a [link](http://example.com)\n">>,
+   <<"| a | b |\n|---|---|\n| 1 | 2 |\n\n```\ncode\n```\n">>,
+   iolist_to_binary([io_lib:format("Paragraph ~b with *some* text~n~n", [N]) || N <- lists:seq(1, 500)])].
+
+temp_path() ->
+  filename:join("/tmp", "greenbar_file_" ++ integer_to_list(erlang:unique_integer([positive])) ++ ".md").
+
+%% Runs Fun with the path of a file holding Content
+with_file(Content, Fun) ->
+  Path = temp_path(),
+  ok = file:write_file(Path, Content),
+  try
+    Fun(Path)
+  after
+    file:delete(Path)
+  end.
+
+same_as_analyze_test_() ->
+  [{integer_to_list(byte_size(Doc)),
+    fun() ->
+        with_file(Doc, fun(Path) ->
+                           Expected = greenbar_markdown:analyze(Doc, Options),
+                           ?assertEqual(Expected, greenbar_markdown:analyze_file(Path, Options)),
+                           ?assertEqual(Expected, greenbar_markdown:analyze_file(Path, [{mmap, true} | Options])),
+                           ?assertEqual(Expected, greenbar_markdown:analyze_file(Path, [{mmap, false} | Options]))
+                       end)
+    end} || Doc <- documents(), Options <- [[], [{tables, columnar}], [{output, html}]]].
+
+default_options_test() ->
+  Doc = lists:last(documents()),
+  with_file(Doc, fun(Path) ->
+                     ?assertEqual(greenbar_markdown:analyze(Doc), greenbar_markdown:analyze_file(Path))
+                 end).
+
+%% Empty files aren't mapped
+empty_test() ->
+  with_file(<<>>, fun(Path) ->
+                      ?assertEqual({ok, []}, greenbar_markdown:analyze_file(Path)),
+                      ?assertEqual({ok, []}, greenbar_markdown:analyze_file(Path, [{mmap, true}]))
+                  end).
+
+enoent_test_() ->
+  Path = temp_path(),
+  [?_assertEqual({error, enoent}, greenbar_markdown:analyze_file(Path)),
+   ?_assertEqual({error, enoent}, greenbar_markdown:analyze_file(Path, [{mmap, true}]))].
+
+directory_test() ->
+  ?assertEqual({error, eisdir}, greenbar_markdown:analyze_file("/tmp")).
+
+%% The size is checked before anything is read
+input_size_test_() ->
+  Doc = lists:last(documents()),
+  Size = byte_size(Doc),
+  [{atom_to_list(Map),
+    fun() ->
+        with_file(Doc, fun(Path) ->
+                           ?assertEqual({error, limit_exceeded, input_size},
+                                        greenbar_markdown:analyze_file(Path, [{mmap, Map}, {max_input_size, Size - 1}])),
+                           ?assertMatch({ok, [_ | _]},
+                                        greenbar_markdown:analyze_file(Path, [{mmap, Map}, {max_input_size, Size}]))
+                       end)
+    end} || Map <- [false, true]].
+
+bad_mmap_test() ->
+  ?assertError(badarg, greenbar_markdown:analyze_file("/tmp", [{mmap, yes}])).
@@ -0,0 +1,36 @@
+-module(greenbar_markdown_intern_tests).
+
+%% {intern_strings, true} shares repeated texts between nodes without
+%% changing the result.
+
+-include_lib("eunit/include/eunit.hrl").
+
+documents() ->
+  [iolist_to_binary(["| status | owner |\n|---|---|\n",
+                     lists:duplicate(100, "| open | ops |\n| closed | dev |\n")]),
+   iolist_to_binary([io_lib:format("* [docs](http://example.com/~b) and [docs](http://example.com/)~n", [N rem 3])
+                     || N <- lists:seq(1, 100)]),
+   iolist_to_binary(["# Title\n\n", lists:duplicate(50, "Same *words* again\n\n")]),
+   iolist_to_binary(["long ", binary:copy(<<"x">>, 300), "\n\n", binary:copy(<<"y">>, 300), "\n"]),
+   <<>>].
+
+option_sets() ->
+  [[],
+   [{tables, columnar}],
+   [{tables, columnar}, {table_batch_size, 16}],
+   [{normalize_whitespace, true}]].
+
+analyze_test_() ->
+  [?_assertEqual(greenbar_markdown:analyze(Doc, Options),
+                 greenbar_markdown:analyze(Doc, [{intern_strings, true} | Options]))
+   || Doc <- documents(), Options <- option_sets()].
+
+parser_test_() ->
+  {ok, Plain} = greenbar_markdown:new_parser([]),
+  {ok, Interned} = greenbar_markdown:new_parser([{intern_strings, true}]),
+  %% Twice through the same handle, so nothing carries over between calls
+  [?_assertEqual(greenbar_markdown:analyze(Plain, Doc), greenbar_markdown:analyze(Interned, Doc))
+   || Doc <- documents() ++ documents()].
+
+bad_value_test() ->
+  ?assertError(badarg, greenbar_markdown:analyze(<<"text">>, [{intern_strings, yes}])).
@@ -0,0 +1,70 @@
+-module(greenbar_markdown_limits_tests).
+
+%% Each limit of analyze/2 and parser handles stops the parse with its own
+%% error, and deep markup stays within hoedown's nesting ceiling.
+
+-include_lib("eunit/include/eunit.hrl").
+
+paragraphs(Count) ->
+  iolist_to_binary([io_lib:format("Paragraph ~b with *some* text~n~n", [N]) || N <- lists:seq(1, Count)]).
+
+%% A list nested Depth levels deep
+nested_list(Depth) ->
+  iolist_to_binary([[lists:duplicate(2 * Level, $\s), "- item\n"] || Level <- lists:seq(0, Depth - 1)]).
+
+%% Large enough to take well over a millisecond
+slow_document() ->
+  iolist_to_binary(lists:duplicate(20000, <<"Some *italic*, **bold** and `code` with a [link](http://example.com)\n\n">>)).
+
+input_size_test() ->
+  ?assertEqual({error, limit_exceeded, input_size},
+               greenbar_markdown:analyze(<<"hello world">>, [{max_input_size, 5}])),
+  ?assertMatch({ok, _}, greenbar_markdown:analyze(<<"hello">>, [{max_input_size, 5}])).
+
+input_size_iodata_test() ->
+  ?assertEqual({error, limit_exceeded, input_size},
+               greenbar_markdown:analyze([<<"hello">>, [$\s, <<"world">>]], [{max_input_size, 5}])).
+
+nodes_test() ->
+  ?assertEqual({error, limit_exceeded, nodes}, greenbar_markdown:analyze(paragraphs(20), [{max_nodes, 3}])).
+
+nesting_test() ->
+  ?assertEqual({error, limit_exceeded, nesting}, greenbar_markdown:analyze(nested_list(6), [{max_nesting, 3}])).
+
+timeout_test() ->
+  ?assertEqual({error, limit_exceeded, timeout}, greenbar_markdown:analyze(slow_document(), [{timeout, 1}])).
+
+within_limits_test() ->
+  Doc = paragraphs(5),
+  Limits = [{max_input_size, byte_size(Doc)}, {max_nodes, 1000}, {max_nesting, 16}, {timeout, 60000}],
+  ?assertEqual(greenbar_markdown:analyze(Doc), greenbar_markdown:analyze(Doc, Limits)).
+
+%% hoedown gets at most its ceiling whatever max_nesting allows, so very
+%% deep markup parses rather than exhausting the scheduler stack
+deep_nesting_test_() ->
+  Doc = nested_list(200),
+  Quotes = iolist_to_binary([lists:duplicate(200, $>), " quoted\n"]),
+  [?_assertMatch({ok, _}, greenbar_markdown:analyze(Doc, [{max_nesting, 1000}])),
+   ?_assertMatch({ok, _}, greenbar_markdown:analyze(Quotes, [{max_nesting, 1000}])),
+   ?_assertEqual({error, limit_exceeded, nesting}, greenbar_markdown:analyze(Doc, [{max_nesting, 4}]))].
+
+parser_limits_test_() ->
+  {ok, Nodes} = greenbar_markdown:new_parser([{max_nodes, 3}]),
+  {ok, Size} = greenbar_markdown:new_parser([{max_input_size, 5}]),
+  {ok, Nesting} = greenbar_markdown:new_parser([{max_nesting, 3}]),
+  [?_assertEqual({error, limit_exceeded, nodes}, greenbar_markdown:analyze(Nodes, paragraphs(20))),
+   ?_assertEqual({error, limit_exceeded, input_size}, greenbar_markdown:analyze(Size, <<"hello world">>)),
+   ?_assertEqual({error, limit_exceeded, nesting}, greenbar_markdown:analyze(Nesting, nested_list(6))),
+   %% A limit hit leaves the parser usable
+   ?_assertMatch({ok, _}, greenbar_markdown:analyze(Nodes, <<"short">>))].
+
+%% HTML rendering can't count nodes or check a deadline
+html_limits_test_() ->
+  [?_assertError(badarg, greenbar_markdown:analyze(<<"text">>, [{output, html}, {timeout, 10}])),
+   ?_assertError(badarg, greenbar_markdown:new_parser([{output, html}, {max_nodes, 10}])),
+   ?_assertMatch({ok, _}, greenbar_markdown:analyze(<<"text">>, [{output, html}, {max_input_size, 10}])),
+   ?_assertEqual({error, limit_exceeded, input_size},
+                 greenbar_markdown:analyze(<<"hello world">>, [{output, html}, {max_input_size, 5}]))].
+
+bad_limit_test() ->
+  ?assertError(badarg, greenbar_markdown:analyze(<<"text">>, [{max_nodes, -1}])).
@@ -0,0 +1,44 @@
+-module(greenbar_markdown_normalize_tests).
+
+%% {normalize_whitespace, true} parses a document like its tidied form
+%% without the option would be.
+
+-include_lib("eunit/include/eunit.hrl").
+
+normalized(Doc) ->
+  greenbar_markdown:analyze(Doc, [{normalize_whitespace, true}]).
+
+plain(Doc) ->
+  greenbar_markdown:analyze(Doc, []).
+
+crlf_test_() ->
+  [?_assertEqual(plain(<<"a\nb\n">>), normalized(<<"a\r\nb\r\n">>)),
+   ?_assertEqual(plain(<<"# Title\n\ntext\n">>), normalized(<<"# Title\r\n\r\ntext\r\n">>)),
+   ?_assertEqual(plain(<<"```\ncode\n```\n">>), normalized(<<"```\r\ncode\r\n```\r\n">>))].
+
+%% Two trailing spaces stay a hard break, more are cut back to two
+hard_break_test_() ->
+  [?_assertEqual(plain(<<"one  \ntwo\n">>), normalized(<<"one  \ntwo\n">>)),
+   ?_assertEqual(plain(<<"one  \ntwo\n">>), normalized(<<"one    \ntwo\n">>)),
+   ?_assertNotEqual(plain(<<"one\ntwo\n">>), normalized(<<"one  \ntwo\n">>))].
+
+blank_runs_test_() ->
+  [?_assertEqual(plain(<<"a\n\nb\n">>), normalized(<<"a\n\n\n\nb\n">>)),
+   ?_assertEqual(plain(<<"a\n\nb\n">>), normalized(<<"a\n \n\t\n\nb\n">>))].
+
+trailing_blanks_test_() ->
+  [?_assertEqual(plain(<<"text\nmore\n">>), normalized(<<"text \t\nmore\n">>)),
+   ?_assertEqual(plain(<<"text\nmore\n">>), normalized(<<"text\t\nmore \n">>))].
+
+%% Fenced code is left as written, apart from line endings
+fence_test_() ->
+  Code = <<"```\ncode  \t\n\n\n\nmore \n```\n">>,
+  [?_assertEqual(plain(Code), normalized(Code)),
+   ?_assertEqual(plain(<<"```\ncode  \t\n```\n\nafter\n">>),
+                 normalized(<<"```\ncode  \t\n```\n\n\n\nafter \n">>))].
+
+parser_test() ->
+  {ok, Parser} = greenbar_markdown:new_parser([{normalize_whitespace, true}]),
+  Doc = <<"a \r\n\r\n\r\nb  \r\nc\r\n">>,
+  ?assertEqual(normalized(Doc), greenbar_markdown:analyze(Parser, Doc)),
+  ?assertEqual(plain(<<"a\n\nb  \nc\n">>), greenbar_markdown:analyze(Parser, Doc)).
@@ -0,0 +1,45 @@
+-module(greenbar_markdown_pages_tests).
+
+%% {page_bytes, N} splits code blocks into pages of at most N bytes, on
+%% newlines where it can and otherwise on UTF-8 character boundaries.
+
+-include_lib("eunit/include/eunit.hrl").
+
+fence(Text) ->
+  iolist_to_binary(["```\n", Text, "\n```\n"]).
+
+code_block(Doc, Options) ->
+  {ok, Nodes} = greenbar_markdown:analyze(Doc, Options),
+  [Block] = [Node || Node <- Nodes, maps:get(name, Node) =:= fixed_width_block],
+  Block.
+
+join([], _Separator) ->
+  <<>>;
+join([First | Rest], Separator) ->
+  iolist_to_binary([First | [[Separator, Page] || Page <- Rest]]).
+
+newlines_test() ->
+  Lines = [io_lib:format("line ~2..0b", [N]) || N <- lists:seq(1, 30)],
+  #{text := Text, pages := Pages} = code_block(fence(join(Lines, "\n")), [{page_bytes, 20}]),
+  ?assert(length(Pages) > 1),
+  ?assert(lists:all(fun(Page) -> byte_size(Page) =< 20 end, Pages)),
+  ?assertEqual(Text, join(Pages, "\n")).
+
+%% A line longer than a page is cut without splitting a character
+utf8_test_() ->
+  Text = binary:copy(<<"é"/utf8>>, 50),
+  [{integer_to_list(Bytes),
+    fun() ->
+        #{text := Block, pages := Pages} = code_block(fence(Text), [{page_bytes, Bytes}]),
+        ?assert(lists:all(fun(Page) -> byte_size(Page) =< Bytes end, Pages)),
+        ?assert(lists:all(fun(Page) -> unicode:characters_to_binary(Page) =:= Page end, Pages)),
+        ?assertEqual(Block, join(Pages, ""))
+    end} || Bytes <- [15, 16, 33]].
+
+%% A block that fits is one page
+single_page_test() ->
+  #{text := Text, pages := Pages} = code_block(fence(<<"short">>), [{page_bytes, 1024}]),
+  ?assertEqual([Text], Pages).
+
+no_pages_test() ->
+  ?assertNot(maps:is_key(pages, code_block(fence(<<"short">>), []))).
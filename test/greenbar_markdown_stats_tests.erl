@@ -0,0 +1,59 @@
+-module(greenbar_markdown_stats_tests).
+
+%% stats/0 has the documented shape and its counters move with parses.
+%% Counters are global, so the tests only check that they grow.
+
+-include_lib("eunit/include/eunit.hrl").
+
+keys_test() ->
+  Stats = greenbar_markdown:stats(),
+  ?assertEqual(lists:sort([calls, input_bytes, errors, nodes, limits, pool,
+                           parse_us, convert_us, peak_kb, memory]),
+               lists:sort(maps:keys(Stats))),
+  ?assertEqual(lists:sort([input_size, nodes, nesting, timeout]),
+               lists:sort(maps:keys(maps:get(limits, Stats)))),
+  ?assertEqual([hits, misses], lists:sort(maps:keys(maps:get(pool, Stats)))),
+  ?assertEqual(lists:sort([current, peak, allocated, allocations, largest_call_peak]),
+               lists:sort(maps:keys(maps:get(memory, Stats)))).
+
+counters_test() ->
+  Doc = <<"# Title\n\nSome *text*\n">>,
+  Before = greenbar_markdown:stats(),
+  {ok, _} = greenbar_markdown:analyze(Doc),
+  After = greenbar_markdown:stats(),
+  ?assert(maps:get(calls, After) >= maps:get(calls, Before) + 1),
+  ?assert(maps:get(input_bytes, After) >= maps:get(input_bytes, Before) + byte_size(Doc)),
+  ?assert(maps:get(header, maps:get(nodes, After)) >= maps:get(header, maps:get(nodes, Before)) + 1).
+
+limits_test() ->
+  Count = fun(Which) -> maps:get(Which, maps:get(limits, greenbar_markdown:stats())) end,
+  Size = Count(input_size),
+  Nodes = Count(nodes),
+  {error, limit_exceeded, input_size} = greenbar_markdown:analyze(<<"hello world">>, [{max_input_size, 5}]),
+  {error, limit_exceeded, nodes} = greenbar_markdown:analyze(<<"a\n\nb\n\nc\n\nd\n">>, [{max_nodes, 2}]),
+  ?assert(Count(input_size) >= Size + 1),
+  ?assert(Count(nodes) >= Nodes + 1).
+
+histograms_test_() ->
+  {ok, _} = greenbar_markdown:analyze(<<"text">>),
+  Stats = greenbar_markdown:stats(),
+  [{atom_to_list(Name),
+    fun() ->
+        Histogram = maps:get(Name, Stats),
+        {Bounds, Counts} = lists:unzip(Histogram),
+        ?assertEqual(infinity, lists:last(Bounds)),
+        Finite = lists:droplast(Bounds),
+        ?assertEqual(Finite, lists:usort(Finite)),
+        ?assert(lists:all(fun(Count) -> is_integer(Count) andalso Count >= 0 end, Counts)),
+        ?assert(lists:sum(Counts) > 0)
+    end} || Name <- [parse_us, convert_us, peak_kb]].
+
+%% Past the arena's input size, so the call allocates counted memory
+memory_test() ->
+  {ok, _} = greenbar_markdown:analyze(binary:copy(<<"Some *text* to parse\n\n">>, 100)),
+  #{current := Current, peak := Peak, allocated := Allocated, allocations := Allocations,
+    largest_call_peak := LargestCallPeak} = maps:get(memory, greenbar_markdown:stats()),
+  ?assert(Peak >= Current),
+  ?assert(Allocated >= Peak),
+  ?assert(Allocations > 0),
+  ?assert(LargestCallPeak > 0).
@@ -0,0 +1,76 @@
+-module(greenbar_markdown_stream_tests).
+
+%% analyze_stream/3 sends the nodes of analyze/2 in order, then
+%% greenbar_done, including when a limit stops the parse part way.
+
+-include_lib("eunit/include/eunit.hrl").
+
+paragraphs(Count) ->
+  iolist_to_binary([io_lib:format("Paragraph ~b with *some* text~n~n", [N]) || N <- lists:seq(1, Count)]).
+
+documents() ->
+  [<<>>,
+   <<"single line">>,
+   <<"# Title\n\nSome *text* and a [link](http://example.com)\n\n```\ncode\n```\n">>,
+   <<"| a | b |\n|---|---|\n| 1 | 2 |\n\n- one\n- two\n\nlast\n">>,
+   paragraphs(100)].
+
+%% Runs analyze_stream with a process that collects the messages and
+%% returns {Return, Blocks, Result}
+stream(Doc, Options) ->
+  Parent = self(),
+  Collector = spawn_link(fun() -> collect(Parent, []) end),
+  Return = greenbar_markdown:analyze_stream(Doc, Collector, Options),
+  receive
+    {collected, Collector, Ref, Blocks, Result} ->
+      case Return of
+        {ok, Returned} -> ?assertEqual(Ref, Returned);
+        _ -> ok
+      end,
+      {Return, Blocks, Result}
+  after 5000 ->
+      erlang:error(no_done)
+  end.
+
+collect(Parent, Blocks) ->
+  receive
+    {greenbar_block, Ref, Node} ->
+      collect(Parent, [{Ref, Node} | Blocks]);
+    {greenbar_done, Ref, Result} ->
+      %% Every block carries the ref of its done message
+      Nodes = [Node || {Ref0, Node} <- lists:reverse(Blocks), Ref0 =:= Ref],
+      length(Nodes) =:= length(Blocks) orelse erlang:error(mixed_refs),
+      Parent ! {collected, self(), Ref, Nodes, Result}
+  end.
+
+in_order_test_() ->
+  [{integer_to_list(byte_size(Doc)),
+    fun() ->
+        {ok, Nodes} = greenbar_markdown:analyze(Doc, Options),
+        ?assertMatch({{ok, _}, Nodes, ok}, stream(Doc, Options))
+    end} || Doc <- documents(), Options <- [[], [{tables, columnar}], [{intern_strings, true}]]].
+
+%% A limit hit part way still ends with greenbar_done, after the nodes
+%% that were already final
+limit_test() ->
+  Doc = paragraphs(200),
+  {ok, All} = greenbar_markdown:analyze(Doc),
+  Error = {error, limit_exceeded, nodes},
+  {Return, Blocks, Result} = stream(Doc, [{max_nodes, 200}]),
+  ?assertEqual(Error, Return),
+  ?assertEqual(Error, Result),
+  ?assertNotEqual([], Blocks),
+  ?assert(length(Blocks) < length(All)),
+  ?assert(lists:prefix(Blocks, All)).
+
+input_size_test() ->
+  ?assertEqual({{error, limit_exceeded, input_size}, [], {error, limit_exceeded, input_size}},
+               stream(<<"hello world">>, [{max_input_size, 5}])).
+
+self_test() ->
+  ?assertError(badarg, greenbar_markdown:analyze_stream(<<"text">>, self(), [])).
+
+html_test() ->
+  Collector = spawn(fun() -> receive stop -> ok end end),
+  ?assertError(badarg, greenbar_markdown:analyze_stream(<<"text">>, Collector, [{output, html}])),
+  Collector ! stop.
@@ -0,0 +1,70 @@
+-module(greenbar_markdown_tables_tests).
+
+%% {tables, columnar} returns plain text tables column oriented, grouped
+%% into batches with table_batch_size, and leaves other tables as trees.
+
+-include_lib("eunit/include/eunit.hrl").
+
+-define(ROWS, 5).
+
+plain_table() ->
+  iolist_to_binary(["| name | value |\n|---|---|\n",
+                    [io_lib:format("| row ~b | ~b |~n", [N, N * N]) || N <- lists:seq(1, ?ROWS)]]).
+
+expected_rows() ->
+  [{iolist_to_binary(io_lib:format("row ~b", [N])), integer_to_binary(N * N)} || N <- lists:seq(1, ?ROWS)].
+
+tables(Doc, Options) ->
+  {ok, Nodes} = greenbar_markdown:analyze(Doc, Options),
+  [Node || Node <- walk(Nodes), maps:get(name, Node) =:= table].
+
+walk(Nodes) ->
+  lists:flatmap(fun(#{children := Children} = Node) -> [Node | walk(Children)];
+                   (Node) -> [Node]
+                end, Nodes).
+
+columnar_test() ->
+  [Table] = tables(plain_table(), [{tables, columnar}]),
+  ?assertEqual([<<"name">>, <<"value">>], maps:get(header, Table)),
+  ?assertEqual([none, none], maps:get(alignments, Table)),
+  ?assertEqual(expected_rows(), maps:get(rows, Table)),
+  ?assertNot(maps:is_key(children, Table)).
+
+tree_by_default_test() ->
+  [Table] = tables(plain_table(), []),
+  ?assert(maps:is_key(children, Table)),
+  ?assertNot(maps:is_key(rows, Table)).
+
+batches_test_() ->
+  [{integer_to_list(Size),
+    fun() ->
+        [Table] = tables(plain_table(), [{tables, columnar}, {table_batch_size, Size}]),
+        Batches = maps:get(row_batches, Table),
+        ?assertNot(maps:is_key(rows, Table)),
+        ?assertEqual(expected_rows(), lists:append(Batches)),
+        ?assertEqual((?ROWS + Size - 1) div Size, length(Batches)),
+        ?assert(lists:all(fun(Batch) -> length(Batch) =< Size end, Batches))
+    end} || Size <- [1, 2, ?ROWS, ?ROWS + 3]].
+
+%% A batch size means nothing without columnar tables
+batch_size_alone_test() ->
+  ?assertEqual(greenbar_markdown:analyze(plain_table(), []),
+               greenbar_markdown:analyze(plain_table(), [{table_batch_size, 2}])).
+
+%% Cells with markup keep their nodes
+markup_stays_a_tree_test() ->
+  Doc = <<"| a | b |\n|---|---|\n| *x* | y |\n| 1 | `2` |\n">>,
+  [Table] = tables(Doc, [{tables, columnar}]),
+  ?assert(maps:is_key(children, Table)),
+  ?assertEqual(greenbar_markdown:analyze(Doc, []), greenbar_markdown:analyze(Doc, [{tables, columnar}])).
+
+%% Large plain tables are built without hoedown's table callbacks
+large_table_test() ->
+  Rows = 500,
+  Doc = iolist_to_binary(["| a | b | c |\n|---|---|---|\n",
+                          [io_lib:format("| ~b | x~b | y |~n", [N, N]) || N <- lists:seq(1, Rows)]]),
+  [Table] = tables(Doc, [{tables, columnar}]),
+  TableRows = maps:get(rows, Table),
+  ?assertEqual(Rows, length(TableRows)),
+  ?assertEqual({<<"1">>, <<"x1">>, <<"y">>}, hd(TableRows)),
+  ?assertEqual({integer_to_binary(Rows), <<"x", (integer_to_binary(Rows))/binary>>, <<"y">>}, lists:last(TableRows)).
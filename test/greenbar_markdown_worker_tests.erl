@@ -0,0 +1,58 @@
+-module(greenbar_markdown_worker_tests).
+
+%% gb_worker writes results with its own term encoder, so its answers are
+%% checked against the NIF's for each output, table layout and limit.
+
+-include_lib("eunit/include/eunit.hrl").
+
+-define(TABLE_ROWS, 40).
+
+documents() ->
+  [<<>>,
+   <<"# Title\n\nSome *italic*, **bold** and ~~struck~~ text with a [link](http://example.com).\n">>,
+   <<"Line one  \nline two\n\n\n\nAfter blank lines\n">>,
+   <<"- one\n- two\n  1. nested\n  2. ordered\n- `code`\n">>,
+   <<"```\nfixed width\n  block\n```\n\nInline `fixed` text\n">>,
+   <<"| a | b |\n|:--|--:|\n| *x* | y |\n| 1 | 2 |\n">>,
+   iolist_to_binary(["| name | value |\n|---|:-:|\n",
+                     [io_lib:format("| row ~b | ~b |~n", [N, N * N]) || N <- lists:seq(1, ?TABLE_ROWS)],
+                     "\nAfter the table\n"]),
+   <<"> quoted\n\n#### Deep header\n\n- [ ] a\n  - b\n    - c\n      - d\n">>].
+
+option_sets() ->
+  [[],
+   [{tables, columnar}],
+   [{tables, columnar}, {table_batch_size, 7}],
+   [{output, json}],
+   [{output, json}, {tables, columnar}],
+   [{normalize_whitespace, true}],
+   [{max_nodes, 3}],
+   [{max_input_size, 16}],
+   [{max_nesting, 1}]].
+
+same_as_nif_test_() ->
+  [{setup,
+    fun() -> start(Options) end,
+    fun stop/1,
+    fun({Parser, Worker}) ->
+        [?_assertEqual({Options, greenbar_markdown:analyze(Parser, Doc)},
+                       {Options, greenbar_markdown_worker:analyze(Worker, Doc)}) || Doc <- documents()]
+    end} || Options <- option_sets()].
+
+iodata_test_() ->
+  {setup,
+   fun() -> start([]) end,
+   fun stop/1,
+   fun({Parser, Worker}) ->
+       Text = [<<"# Ti">>, [$t, "le\n\n"], [[<<"body *text*">>]], $\n],
+       [?_assertEqual(greenbar_markdown:analyze(Parser, Text), greenbar_markdown_worker:analyze(Worker, Text))]
+   end}.
+
+start(Options) ->
+  {ok, Parser} = greenbar_markdown:new_parser(Options),
+  {ok, Worker} = greenbar_markdown_worker:start_link(Options),
+  {Parser, Worker}.
+
+stop({_Parser, Worker}) ->
+  unlink(Worker),
+  greenbar_markdown_worker:stop(Worker).